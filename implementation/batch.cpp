@@ -0,0 +1,238 @@
+
+#include "batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+namespace mesh {
+
+    batch_executor::batch_executor(std::size_t io_threads, std::size_t queue_capacity, std::size_t cache_budget_bytes)
+            : capacity(queue_capacity ? queue_capacity : 1), cache(cache_budget_bytes) {
+        for (std::size_t i = 0; i < (io_threads ? io_threads : 1); ++i)
+            loaders.emplace_back(&batch_executor::load_loop, this);
+        computer = std::thread(&batch_executor::compute_loop, this);
+    }
+
+    batch_executor::~batch_executor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        job_available.notify_all();
+        prepared_available.notify_all();
+
+        for (auto &loader : loaders)
+            loader.join();
+        computer.join();
+    }
+
+    std::future<batch_result> batch_executor::submit(batch_job job) {
+        pending_job p {std::move(job), std::promise<batch_result>()};
+        std::future<batch_result> result = p.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(p));
+        }
+        job_available.notify_one();
+        return result;
+    }
+
+    // meshes shared by several jobs are only loaded once while they stay in the cache
+    std::shared_ptr<const prepared_mesh> batch_executor::load(const std::string &path) {
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            std::shared_ptr<const prepared_mesh> cached = cache.find(path);
+            if (cached)
+                return cached;
+        }
+        std::shared_ptr<const prepared_mesh> loaded = load_prepared_mesh(path);
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        cache.insert(path, loaded);
+        return loaded;
+    }
+
+    void batch_executor::load_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            job_available.wait(lock, [this]{ return stopping || !pending.empty(); });
+            if (pending.empty())
+                return;
+
+            pending_job job = std::move(pending.front());
+            pending.pop_front();
+            ++loading;
+            lock.unlock();
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::shared_ptr<const prepared_mesh> first, second;
+            bool loaded = false;
+            try {
+                first = load(job.job.first_path);
+                second = load(job.job.second_path);
+                loaded = true;
+            } catch (...) {
+                job.promise.set_exception(std::current_exception());
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            lock.lock();
+            if (loaded) {
+                // backpressure, prepared meshes are large
+                prepared_taken.wait(lock, [this]{ return prepared.size() < capacity; });
+                prepared.push_back({std::move(job), std::move(first), std::move(second), seconds});
+            }
+            --loading;
+            prepared_available.notify_one();
+        }
+    }
+
+    void batch_executor::compute_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            prepared_available.wait(lock, [this]{
+                return !prepared.empty() || (stopping && pending.empty() && loading == 0);
+            });
+            if (prepared.empty())
+                return;
+
+            prepared_job job = std::move(prepared.front());
+            prepared.pop_front();
+            lock.unlock();
+            prepared_taken.notify_one();
+
+            try {
+                batch_result result;
+                result.load_seconds = job.load_seconds;
+                result.volume = intersection_volume(*job.first, *job.second, job.pending.job.opts, &result.report);
+                job.pending.promise.set_value(std::move(result));
+            } catch (...) {
+                job.pending.promise.set_exception(std::current_exception());
+            }
+
+            lock.lock();
+        }
+    }
+
+    void one_vs_many(const prepared_mesh &reference, const std::vector<std::string> &paths, const options &opts,
+                     const std::function<void(std::size_t index, const batch_result &result)> &emit) {
+        // bounds the number of prepared meshes in memory
+        constexpr std::size_t chunk_size = 64;
+
+        options serial = opts;
+        serial.threads = 1;
+
+        std::vector<std::shared_ptr<const prepared_mesh>> meshes;
+        std::vector<batch_result> results;
+        std::vector<unsigned char> large;
+        for (std::size_t begin = 0; begin < paths.size(); begin += chunk_size) {
+            const std::size_t count = std::min(chunk_size, paths.size() - begin);
+            meshes.assign(count, nullptr);
+            results.assign(count, batch_result());
+            large.assign(count, 0);
+
+            // small pairs are computed right after loading, with a serial engine per pair
+            #pragma omp parallel for schedule(dynamic)
+            for (std::int64_t i = 0; i < (std::int64_t) count; ++i) {
+                batch_result &result = results[i];
+                try {
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    meshes[i] = load_prepared_mesh(paths[begin + i]);
+                    result.load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                    if (bounding_boxes_overlap(reference, *meshes[i])
+                            && estimated_cost(reference.triangles, meshes[i]->triangles, opts) > parallel_pair_cost) {
+                        large[i] = 1;
+                        continue;
+                    }
+                    result.volume = intersection_volume(reference, *meshes[i], serial, &result.report);
+                } catch (const std::exception &e) {
+                    result.error = e.what();
+                }
+                meshes[i].reset();
+            }
+
+            // large pairs one after the other, each with every thread
+            for (std::size_t i = 0; i < count; ++i) {
+                if (!large[i])
+                    continue;
+                try {
+                    results[i].volume = intersection_volume(reference, *meshes[i], opts, &results[i].report);
+                } catch (const std::exception &e) {
+                    results[i].error = e.what();
+                }
+                meshes[i].reset();
+            }
+
+            for (std::size_t i = 0; i < count; ++i)
+                emit(begin + i, results[i]);
+        }
+    }
+
+    std::vector<std::pair<std::size_t, std::size_t>> overlapping_pairs(const std::vector<std::shared_ptr<const prepared_mesh>> &meshes) {
+        std::vector<std::size_t> order(meshes.size());
+        for (std::size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return meshes[a]->min.x < meshes[b]->min.x; });
+
+        // boxes whose x interval still reaches the current sweep position
+        std::vector<std::size_t> active;
+        std::vector<std::pair<std::size_t, std::size_t>> pairs;
+        for (std::size_t i : order) {
+            const prepared_mesh &mesh = *meshes[i];
+            active.erase(std::remove_if(active.begin(), active.end(), [&](std::size_t j) { return meshes[j]->max.x < mesh.min.x; }),
+                         active.end());
+            for (std::size_t j : active) {
+                if (bounding_boxes_overlap(mesh, *meshes[j]))
+                    pairs.emplace_back(std::min(i, j), std::max(i, j));
+            }
+            active.push_back(i);
+        }
+
+        std::sort(pairs.begin(), pairs.end());
+        return pairs;
+    }
+
+    std::vector<pair_volume> all_pairs(const std::vector<std::shared_ptr<const prepared_mesh>> &meshes, const options &opts) {
+        std::vector<std::pair<std::size_t, std::size_t>> pairs = overlapping_pairs(meshes);
+        std::vector<myfloat> volumes(pairs.size(), 0);
+        std::vector<unsigned char> large(pairs.size(), 0);
+        std::exception_ptr error;
+
+        options serial = opts;
+        serial.threads = 1;
+
+        // as in one_vs_many, cheap pairs run concurrently and the large ones get every thread afterwards
+        #pragma omp parallel for schedule(dynamic)
+        for (std::int64_t i = 0; i < (std::int64_t) pairs.size(); ++i) {
+            const prepared_mesh &first = *meshes[pairs[i].first], &second = *meshes[pairs[i].second];
+            if (estimated_cost(first.triangles, second.triangles, opts) > parallel_pair_cost) {
+                large[i] = 1;
+                continue;
+            }
+            try {
+                volumes[i] = intersection_volume(first, second, serial);
+            } catch (...) {
+                #pragma omp critical
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+
+        for (std::size_t i = 0; i < pairs.size(); ++i) {
+            if (large[i])
+                volumes[i] = intersection_volume(*meshes[pairs[i].first], *meshes[pairs[i].second], opts);
+        }
+
+        std::vector<pair_volume> matrix;
+        for (std::size_t i = 0; i < pairs.size(); ++i) {
+            if (volumes[i] != 0)
+                matrix.push_back({pairs[i].first, pairs[i].second, volumes[i]});
+        }
+        return matrix;
+    }
+}
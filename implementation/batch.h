@@ -0,0 +1,105 @@
+#ifndef MI_BATCH_H
+#define MI_BATCH_H
+
+#include "engine.h"
+#include "server.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mesh {
+
+    struct batch_job {
+        std::string first_path;
+        std::string second_path;
+        options opts;
+    };
+
+    struct batch_result {
+        myfloat volume = 0;
+        engine_report report;
+        // time the job spent loading and preparing its meshes on an io thread
+        double load_seconds = 0;
+        // set by one_vs_many if the pair failed, the executor rethrows through the future instead
+        std::string error;
+    };
+
+    // io threads load and prepare the meshes of upcoming jobs while a single compute thread runs the engines,
+    // which use the openmp threads themselves. at most queue_capacity prepared jobs wait for the compute thread,
+    // further io threads block until it catches up. jobs are computed in the order their meshes become ready.
+    class batch_executor {
+    public:
+        explicit batch_executor(std::size_t io_threads = 2, std::size_t queue_capacity = 4,
+                                std::size_t cache_budget_bytes = std::size_t(1) << 30);
+        // finishes every submitted job
+        ~batch_executor();
+
+        batch_executor(const batch_executor &) = delete;
+        batch_executor &operator=(const batch_executor &) = delete;
+
+        // load and engine errors are rethrown by the future
+        std::future<batch_result> submit(batch_job job);
+
+    private:
+        struct pending_job {
+            batch_job job;
+            std::promise<batch_result> promise;
+        };
+
+        struct prepared_job {
+            pending_job pending;
+            std::shared_ptr<const prepared_mesh> first, second;
+            double load_seconds;
+        };
+
+        void load_loop();
+        void compute_loop();
+        std::shared_ptr<const prepared_mesh> load(const std::string &path);
+
+        std::size_t capacity;
+        bool stopping = false;
+        std::size_t loading = 0;
+
+        std::mutex mutex;
+        std::condition_variable job_available, prepared_available, prepared_taken;
+        std::deque<pending_job> pending;
+        std::deque<prepared_job> prepared;
+
+        std::mutex cache_mutex;
+        mesh_cache cache;
+
+        std::vector<std::thread> loaders;
+        std::thread computer;
+    };
+
+    // pairs above this estimated cost get every openmp thread, the cheaper ones run concurrently with one thread each
+    constexpr double parallel_pair_cost = 1e6;
+
+    // intersects the reference with every mesh in paths, the reference is prepared once. the meshes are loaded in
+    // chunks on the openmp threads and emit is called on the calling thread in the order of paths
+    void one_vs_many(const prepared_mesh &reference, const std::vector<std::string> &paths, const options &opts,
+                     const std::function<void(std::size_t index, const batch_result &result)> &emit);
+
+    // one entry of the sparse volume matrix, first < second
+    struct pair_volume {
+        std::size_t first, second;
+        myfloat volume;
+    };
+
+    // sweep and prune along x, the pairs with overlapping bounding boxes sorted by (first, second)
+    std::vector<std::pair<std::size_t, std::size_t>> overlapping_pairs(const std::vector<std::shared_ptr<const prepared_mesh>> &meshes);
+
+    // intersection volume of every pair of meshes with overlapping bounding boxes, the pairs with an empty
+    // intersection are left out. rethrows the first engine error
+    std::vector<pair_volume> all_pairs(const std::vector<std::shared_ptr<const prepared_mesh>> &meshes, const options &opts);
+}
+
+#endif
@@ -0,0 +1,144 @@
+
+#include "breakdown.h"
+#include "classify.h"
+#include "evaluation.h"
+#include "grid.h"
+#include "mesh.h"
+#include "reduction.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+namespace mesh {
+
+    // the sums of one block of triangles per pair of parts, a block usually touches only a few pairs
+    struct part_sums {
+        std::vector<std::pair<std::size_t, eval::compensated_sum<myfloat>>> entries;
+        std::size_t last = 0;
+
+        void add(std::size_t pair, myfloat value) {
+            if (last >= entries.size() || entries[last].first != pair) {
+                last = 0;
+                while (last < entries.size() && entries[last].first != pair)
+                    ++last;
+                if (last == entries.size())
+                    entries.emplace_back(pair, eval::compensated_sum<myfloat>());
+            }
+            entries[last].second.add(value);
+        }
+    };
+
+    // numbers the distinct values of parts densely in ascending order
+    std::vector<std::size_t> dense_parts(const std::vector<std::size_t> &parts, std::vector<std::size_t> &values) {
+        values = parts;
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+
+        std::vector<std::size_t> dense(parts.size());
+        for (std::size_t i = 0; i < parts.size(); ++i)
+            dense[i] = std::lower_bound(values.begin(), values.end(), parts[i]) - values.begin();
+        return dense;
+    }
+
+    // the sides of one mesh against the triangles of the other, a pair of parts is numbered first * second_count + second
+    void evaluate_part_sides(const std::vector<ntriangle> &lines, const std::vector<std::size_t> &line_parts,
+                             const std::vector<ntriangle> &triangles, const std::vector<std::size_t> &triangle_parts,
+                             const triangle_grid &grid, const projected_classifier &classifier, eval::perturbation p,
+                             std::size_t second_count, std::vector<part_sums> &sums) {
+        const std::size_t npos = std::numeric_limits<std::size_t>::max();
+        const bool lines_first = p == eval::lines_of_first_mesh;
+        sums.assign((lines.size() + reduction_block_size - 1) / reduction_block_size, part_sums());
+
+        // every block of lines is summed by a single thread
+        #pragma omp parallel for schedule(dynamic)
+        for (std::int64_t b = 0; b < (std::int64_t) sums.size(); ++b) {
+            const std::size_t first = std::size_t(b) * reduction_block_size;
+            const std::size_t last = std::min(first + reduction_block_size, lines.size());
+            part_sums &block = sums[b];
+            std::vector<std::size_t> candidates, crossed;
+
+            for (std::size_t i = first; i < last; ++i) {
+                const ntriangle &t = lines[i];
+                myvec min = glm::min(t.a, glm::min(t.b, t.c)), max = glm::max(t.a, glm::max(t.b, t.c));
+                // outside the box of the other mesh, no point of the triangle lies inside it
+                if (glm::any(glm::greaterThan(min, grid.max())) || glm::any(glm::lessThan(max, grid.min())))
+                    continue;
+
+                candidates.clear();
+                grid.query(min, max, [&](std::size_t triangle) { candidates.push_back(triangle); });
+
+                auto pair = [&](std::size_t other_part) {
+                    return lines_first ? line_parts[i] * second_count + other_part : other_part * second_count + line_parts[i];
+                };
+
+                for (std::size_t k = 0; k < 3; ++k) {
+                    triangle_side side = extract_side(t, k);
+                    crossed.clear();
+                    for (std::size_t candidate : candidates) {
+                        const ntriangle &u = triangles[candidate];
+                        myfloat scalar;
+                        if (eval::find_crossing(u, side, p, scalar) != eval::crossing::on_segment)
+                            continue;
+
+                        myvec intersection_point = (1 - scalar) * side.start + scalar * side.end;
+                        block.add(pair(triangle_parts[candidate]),
+                                  eval::generate_intersection_terms(intersection_point, side.end - side.start, side.n, u.n));
+                        crossed.push_back(triangle_parts[candidate]);
+                    }
+
+                    // the end lies inside the parts whose parity changed an odd number of times from the start
+                    std::size_t start = classifier.containing_part(side.start, triangle_parts);
+                    if (start != npos) {
+                        block.add(pair(start), eval::evaluate_line_intersection(side, true, false));
+                        crossed.push_back(start);
+                    }
+                    std::size_t end = lowest_odd_part(crossed);
+                    if (end != npos)
+                        block.add(pair(end), eval::evaluate_line_intersection(side, false, true));
+                }
+            }
+        }
+    }
+
+    std::vector<part_volume> intersection_breakdown(const prepared_mesh &first_mesh, const std::vector<std::size_t> &first_parts,
+                                                    const prepared_mesh &second_mesh, const std::vector<std::size_t> &second_parts) {
+        if (first_parts.size() != first_mesh.triangles.size() || second_parts.size() != second_mesh.triangles.size())
+            throw std::invalid_argument("Expected one part per triangle.");
+        if (!bounding_boxes_overlap(first_mesh, second_mesh))
+            return {};
+
+        std::vector<std::size_t> first_values, second_values;
+        std::vector<std::size_t> first_dense = dense_parts(first_parts, first_values);
+        std::vector<std::size_t> second_dense = dense_parts(second_parts, second_values);
+
+        myvec origin = local_origin(first_mesh.triangles, second_mesh.triangles);
+        std::vector<ntriangle> first = convert_precision<myfloat>(first_mesh.triangles, origin);
+        std::vector<ntriangle> second = convert_precision<myfloat>(second_mesh.triangles, origin);
+        triangle_grid first_grid(first), second_grid(second);
+        projected_classifier first_classifier(first, eval::lines_of_second_mesh), second_classifier(second, eval::lines_of_first_mesh);
+
+        std::vector<part_sums> first_sums, second_sums;
+        evaluate_part_sides(first, first_dense, second, second_dense, second_grid, second_classifier, eval::lines_of_first_mesh,
+                            second_values.size(), first_sums);
+        evaluate_part_sides(second, second_dense, first, first_dense, first_grid, first_classifier, eval::lines_of_second_mesh,
+                            second_values.size(), second_sums);
+
+        // the blocks are combined in their order, so the result does not depend on the thread count
+        std::map<std::size_t, eval::compensated_sum<myfloat>> pairs;
+        for (const auto *sums : {&first_sums, &second_sums})
+            for (const part_sums &block : *sums)
+                for (const auto &entry : block.entries)
+                    pairs[entry.first].add(entry.second);
+
+        std::vector<part_volume> result;
+        for (const auto &entry : pairs) {
+            myfloat volume = entry.second.value() / 6;
+            if (volume != 0)
+                result.push_back({first_values[entry.first / second_values.size()], second_values[entry.first % second_values.size()], volume});
+        }
+        return result;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef MI_BREAKDOWN_H
+#define MI_BREAKDOWN_H
+
+#include "engine.h"
+#include "globals.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace mesh {
+
+    // intersection volume of a part of the first mesh with a part of the second mesh
+    struct part_volume {
+        std::size_t first_part, second_part;
+        myfloat volume;
+    };
+
+    // intersection volume of every part of the first mesh with every part of the second mesh in a single traversal.
+    // the parts hold one value per triangle, like its connected component or its stl label. every term lies on a
+    // face of one part, at a crossing with a face of the other mesh or at a vertex inside a part of it, so the terms
+    // are summed per pair of parts. the parts are assumed to be disjoint solids, the volumes add up to the intersection
+    // volume either way. pairs without terms are left out, the entries are sorted by part. throws
+    // std::invalid_argument unless there is one part per triangle
+    std::vector<part_volume> intersection_breakdown(const prepared_mesh &first_mesh, const std::vector<std::size_t> &first_parts,
+                                                    const prepared_mesh &second_mesh, const std::vector<std::size_t> &second_parts);
+}
+
+#endif
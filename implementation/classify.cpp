@@ -0,0 +1,171 @@
+
+#include "classify.h"
+#include "evaluation.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace mesh {
+
+    // sign of the area of (a, b, p) in the xy plane
+    // the endpoints are ordered canonically, so the shared edge of two adjacent triangles always yields opposite signs,
+    // and zero areas are resolved by perturbing p by +-(eps, eps^2) (simulation of simplicity)
+    int edge_sign(const myvec &a, const myvec &b, const myvec &p, eval::perturbation perturbation) {
+        bool swapped = b.x < a.x || (b.x == a.x && b.y < a.y);
+        const myvec &lo = swapped ? b : a;
+        const myvec &hi = swapped ? a : b;
+
+        int sign = eval::cross_sign(hi, lo, p, lo, 2);
+        // first and second order terms of the perturbation
+        if (sign == 0)
+            sign = ((hi.y < lo.y) - (hi.y > lo.y)) * perturbation;
+        if (sign == 0)
+            sign = ((hi.x > lo.x) - (hi.x < lo.x)) * perturbation;
+
+        return swapped ? -sign : sign;
+    }
+
+    // does the ray from point along +z cross the triangle
+    bool crosses_above(const ntriangle &t, const myvec &point, eval::perturbation perturbation) {
+        int orientation = edge_sign(t.a, t.b, point, perturbation);
+        if (orientation == 0 || edge_sign(t.b, t.c, point, perturbation) != orientation
+                || edge_sign(t.c, t.a, point, perturbation) != orientation)
+            return false;
+
+        // the projected orientation equals the sign of the z component of the normal
+        return eval::plane_side(t, point, perturbation) * orientation < 0;
+    }
+
+    projected_classifier::projected_classifier(const std::vector<ntriangle> &mesh, eval::perturbation perturbation)
+            : mesh(&mesh), perturbation(perturbation) {
+        myvec min(std::numeric_limits<myfloat>::infinity());
+        myvec max(-std::numeric_limits<myfloat>::infinity());
+        for (const auto &t : mesh) {
+            for (const auto &vertex : t) {
+                min = glm::min(min, vertex);
+                max = glm::max(max, vertex);
+            }
+        }
+
+        min_x = min.x;
+        min_y = min.y;
+
+        // aim for roughly one triangle per bin, distributed according to the aspect ratio of the projection
+        myfloat width = std::max(max.x - min.x, std::numeric_limits<myfloat>::min());
+        myfloat height = std::max(max.y - min.y, std::numeric_limits<myfloat>::min());
+        myfloat target = std::max(myfloat(1), std::sqrt(myfloat(mesh.size())));
+        myfloat aspect = std::sqrt(width / height);
+
+        constexpr myfloat max_bins = 4096;
+        bins_x = (std::size_t) std::max(myfloat(1), std::min(max_bins, std::ceil(target * aspect)));
+        bins_y = (std::size_t) std::max(myfloat(1), std::min(max_bins, std::ceil(target / aspect)));
+
+        inv_bin_width = bins_x / width;
+        inv_bin_height = bins_y / height;
+
+        auto bin_range = [&](const ntriangle &t, std::size_t &x0, std::size_t &y0, std::size_t &x1, std::size_t &y1) {
+            std::size_t first = bin_index(std::min({t.a.x, t.b.x, t.c.x}), std::min({t.a.y, t.b.y, t.c.y}));
+            std::size_t last = bin_index(std::max({t.a.x, t.b.x, t.c.x}), std::max({t.a.y, t.b.y, t.c.y}));
+            x0 = first % bins_x;
+            y0 = first / bins_x;
+            x1 = last % bins_x;
+            y1 = last / bins_x;
+        };
+
+        // count triangles per bin, then scatter into the compressed layout
+        bin_offsets.assign(bins_x * bins_y + 1, 0);
+        for (const auto &t : mesh) {
+            std::size_t x0, y0, x1, y1;
+            bin_range(t, x0, y0, x1, y1);
+            for (std::size_t y = y0; y <= y1; ++y)
+                for (std::size_t x = x0; x <= x1; ++x)
+                    bin_offsets[y * bins_x + x + 1] += 1;
+        }
+        for (std::size_t i = 1; i < bin_offsets.size(); ++i)
+            bin_offsets[i] += bin_offsets[i - 1];
+
+        bin_triangles.resize(bin_offsets.back());
+        std::vector<std::size_t> fill(bin_offsets.begin(), bin_offsets.end() - 1);
+        for (std::size_t i = 0; i < mesh.size(); ++i) {
+            std::size_t x0, y0, x1, y1;
+            bin_range(mesh[i], x0, y0, x1, y1);
+            for (std::size_t y = y0; y <= y1; ++y)
+                for (std::size_t x = x0; x <= x1; ++x)
+                    bin_triangles[fill[y * bins_x + x]++] = i;
+        }
+    }
+
+    std::size_t projected_classifier::bin_index(myfloat x, myfloat y) const {
+        auto clamp = [](myfloat v, std::size_t bins) {
+            return (std::size_t) std::min(std::max(v, myfloat(0)), myfloat(bins - 1));
+        };
+        return clamp((y - min_y) * inv_bin_height, bins_y) * bins_x + clamp((x - min_x) * inv_bin_width, bins_x);
+    }
+
+    bool projected_classifier::is_inside(const myvec &point) const {
+        if (mesh->empty())
+            return false;
+
+        // bins are clamped, so points outside the projection simply test a border column and never cross
+        std::size_t bin = bin_index(point.x, point.y);
+
+        std::size_t crossings = 0;
+        for (std::size_t i = bin_offsets[bin]; i < bin_offsets[bin + 1]; ++i) {
+            if (crosses_above((*mesh)[bin_triangles[i]], point, perturbation))
+                crossings += 1;
+        }
+        return crossings % 2 == 1;
+    }
+
+    std::size_t lowest_odd_part(std::vector<std::size_t> &parts) {
+        if (parts.size() % 2 == 0)
+            return std::numeric_limits<std::size_t>::max();
+
+        // an odd total has at least one part with an odd count
+        std::sort(parts.begin(), parts.end());
+        std::size_t i = 0;
+        for (;;) {
+            std::size_t j = i;
+            while (j < parts.size() && parts[j] == parts[i])
+                ++j;
+            if ((j - i) % 2 == 1)
+                return parts[i];
+            i = j;
+        }
+    }
+
+    std::size_t projected_classifier::containing_part(const myvec &point, const std::vector<std::size_t> &parts) const {
+        if (mesh->empty())
+            return std::numeric_limits<std::size_t>::max();
+
+        thread_local std::vector<std::size_t> crossed;
+        crossed.clear();
+        std::size_t bin = bin_index(point.x, point.y);
+        for (std::size_t i = bin_offsets[bin]; i < bin_offsets[bin + 1]; ++i) {
+            if (crosses_above((*mesh)[bin_triangles[i]], point, perturbation))
+                crossed.push_back(parts[bin_triangles[i]]);
+        }
+        return lowest_odd_part(crossed);
+    }
+
+    void projected_classifier::classify(const std::vector<myvec> &points, std::vector<char> &inside) const {
+        inside.resize(points.size());
+
+        #pragma omp parallel for
+        for (std::int64_t i = 0; std::size_t(i) < points.size(); ++i) {
+            inside[i] = is_inside(points[i]);
+        }
+    }
+
+    void classify_vertices(const projected_classifier &classifier, const std::vector<ntriangle> &mesh,
+                           std::vector<myvec> &unified_vertices, std::vector<std::size_t> &unified_indices,
+                           std::vector<char> &inside) {
+        unified_vertices.clear();
+        unified_indices.clear();
+        unify_vertices(mesh, unified_vertices, unified_indices);
+        classifier.classify(unified_vertices, inside);
+    }
+}
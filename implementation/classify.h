@@ -0,0 +1,48 @@
+#ifndef MI_CLASSIFY_H
+#define MI_CLASSIFY_H
+
+#include "evaluation.h"
+#include "globals.h"
+
+#include <vector>
+
+namespace mesh {
+
+    // point-in-mesh classification by casting rays along the positive z axis
+    // triangles are binned by their projection onto the xy plane, so every query only tests a single bin column
+    // queries are perturbed like the lines of the given mesh, consistent with eval::find_crossing
+    class projected_classifier {
+    public:
+        projected_classifier(const std::vector<ntriangle> &mesh, eval::perturbation perturbation);
+
+        bool is_inside(const myvec &point) const;
+        // parts[i] is the part of triangle i. the point lies inside every part it crosses an odd number of times,
+        // nested parts are resolved to the lowest one. npos outside of the mesh
+        std::size_t containing_part(const myvec &point, const std::vector<std::size_t> &parts) const;
+        // writes 1 for every point inside the mesh and 0 otherwise
+        void classify(const std::vector<myvec> &points, std::vector<char> &inside) const;
+
+    private:
+        std::size_t bin_index(myfloat x, myfloat y) const;
+
+        const std::vector<ntriangle> *mesh;
+        eval::perturbation perturbation;
+        myfloat min_x, min_y;
+        myfloat inv_bin_width, inv_bin_height;
+        std::size_t bins_x, bins_y;
+        // compressed bin layout, triangles of bin i are bin_triangles[bin_offsets[i] .. bin_offsets[i + 1]]
+        std::vector<std::size_t> bin_offsets;
+        std::vector<std::size_t> bin_triangles;
+    };
+
+    // the lowest part occurring an odd number of times in parts, which is reordered, if their number is odd, npos
+    // otherwise
+    std::size_t lowest_odd_part(std::vector<std::size_t> &parts);
+
+    // classify all unique vertices of a mesh against another mesh
+    void classify_vertices(const projected_classifier &classifier, const std::vector<ntriangle> &mesh,
+                           std::vector<myvec> &unified_vertices, std::vector<std::size_t> &unified_indices,
+                           std::vector<char> &inside);
+}
+
+#endif
@@ -0,0 +1,500 @@
+
+#include "convex.h"
+#include "evaluation.h"
+#include "grid.h"
+#include "mesh.h"
+#include "reduction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+namespace mesh {
+
+    // in units of one (side, triangle) pair of the host brute force engine, like the costs in engine.cpp
+    constexpr double plane_test_cost = 0.1;
+    constexpr double surface_triangle_cost = 15;
+
+    // meshes are mostly read from single precision stl files, relative to the extent of the mesh
+    constexpr myfloat convexity_tolerance = 4 * std::numeric_limits<float>::epsilon();
+
+    myfloat extent(const std::vector<ntriangle> &mesh) {
+        myvec min, max;
+        bounding_box(mesh, min, max);
+        return std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z));
+    }
+
+    // the corner c of triangle c / 3 starts the side towards corner next_corner(c)
+    std::size_t next_corner(std::size_t corner) {
+        return corner % 3 == 2 ? corner - 2 : corner + 1;
+    }
+
+    // the corner whose side runs the other way along the same edge, false unless every edge of the mesh is shared by
+    // exactly two triangles with opposite orientation
+    bool opposite_corners(const std::vector<std::size_t> &indices, std::vector<std::size_t> &opposite) {
+        std::vector<std::tuple<std::size_t, std::size_t, std::size_t>> edges(indices.size());
+        for (std::size_t c = 0; c < indices.size(); ++c)
+            edges[c] = std::make_tuple(indices[c], indices[next_corner(c)], c);
+        std::sort(edges.begin(), edges.end());
+
+        opposite.resize(indices.size());
+        for (std::size_t i = 0; i < edges.size(); ++i) {
+            std::size_t from, to, corner;
+            std::tie(from, to, corner) = edges[i];
+            if (from == to || (i + 1 < edges.size() && std::get<0>(edges[i + 1]) == from && std::get<1>(edges[i + 1]) == to))
+                return false;
+
+            auto twin = std::lower_bound(edges.begin(), edges.end(), std::make_tuple(to, from, std::size_t(0)));
+            if (twin == edges.end() || std::get<0>(*twin) != to || std::get<1>(*twin) != from)
+                return false;
+            opposite[corner] = std::get<2>(*twin);
+        }
+        return true;
+    }
+
+    // bounding sphere of a range of vertices, the first child follows its parent, a leaf has no second child
+    struct vertex_node {
+        myvec centre;
+        myfloat radius;
+        std::size_t first, last;
+        std::size_t second_child = 0;
+    };
+
+    constexpr std::size_t vertex_leaf_size = 16;
+
+    // halves the vertices along the longest axis of their box until a leaf holds at most vertex_leaf_size of them
+    std::size_t build_vertex_tree(std::vector<myvec> &vertices, std::size_t first, std::size_t last, std::vector<vertex_node> &nodes) {
+        myvec min(std::numeric_limits<myfloat>::infinity()), max(-std::numeric_limits<myfloat>::infinity());
+        for (std::size_t i = first; i < last; ++i) {
+            min = glm::min(min, vertices[i]);
+            max = glm::max(max, vertices[i]);
+        }
+
+        std::size_t node = nodes.size();
+        nodes.push_back(vertex_node{(min + max) / myfloat(2), glm::length(max - min) / 2, first, last});
+        if (last - first > vertex_leaf_size) {
+            myvec size = max - min;
+            int axis = size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2;
+            std::size_t middle = first + (last - first) / 2;
+            std::nth_element(vertices.begin() + first, vertices.begin() + middle, vertices.begin() + last,
+                             [axis](const myvec &a, const myvec &b) { return a[axis] < b[axis]; });
+            build_vertex_tree(vertices, first, middle, nodes);
+            std::size_t second = build_vertex_tree(vertices, middle, last, nodes);
+            nodes[node].second_child = second;
+        }
+        return node;
+    }
+
+    // every vertex lies within the tolerance below the plane, spheres entirely below it are skipped
+    bool below_plane(const std::vector<vertex_node> &nodes, const std::vector<myvec> &vertices, const myvec4 &plane, myfloat tolerance) {
+        const myvec n(plane);
+        const myfloat limit = plane.w + tolerance;
+        std::vector<std::size_t> stack(1, 0);
+        while (!stack.empty()) {
+            std::size_t index = stack.back();
+            stack.pop_back();
+            const vertex_node &node = nodes[index];
+            if (glm::dot(n, node.centre) + node.radius <= limit)
+                continue;
+
+            if (node.second_child == 0) {
+                for (std::size_t i = node.first; i < node.last; ++i)
+                    if (!(glm::dot(n, vertices[i]) <= limit))
+                        return false;
+            } else {
+                stack.push_back(index + 1);
+                stack.push_back(node.second_child);
+            }
+        }
+        return true;
+    }
+
+    bool convex_planes(const std::vector<ntriangle> &mesh, convex_faces &faces) {
+        faces = convex_faces();
+        if (mesh.size() < 4 || !(volume(mesh) > 0))
+            return false;
+
+        std::vector<myvec> vertices;
+        std::vector<std::size_t> indices, opposite;
+        unify_vertices(mesh, vertices, indices);
+        if (!opposite_corners(indices, opposite))
+            return false;
+
+        const myfloat tolerance = convexity_tolerance * extent(mesh);
+        auto vertex = [&](std::size_t corner) { return vertices[indices[corner]]; };
+
+        // the third vertex of the neighbour lies below the plane of every triangle, a nan normal fails as well
+        for (std::size_t c = 0; c < indices.size(); ++c) {
+            const ntriangle &t = mesh[c / 3];
+            std::size_t third = next_corner(next_corner(opposite[c]));
+            if (!(glm::dot(t.n, vertex(third) - t.a) <= tolerance))
+                return false;
+        }
+
+        // a second closed shell would satisfy everything else
+        std::vector<bool> reached(mesh.size(), false);
+        std::vector<std::size_t> stack(1, 0);
+        std::size_t count = 1;
+        reached[0] = true;
+        while (!stack.empty()) {
+            std::size_t i = stack.back();
+            stack.pop_back();
+            for (std::size_t k = 0; k < 3; ++k) {
+                std::size_t j = opposite[3 * i + k] / 3;
+                if (reached[j])
+                    continue;
+                reached[j] = true;
+                ++count;
+                stack.push_back(j);
+            }
+        }
+        if (count != mesh.size())
+            return false;
+
+        // coplanar neighbours join the plane of the triangle they were reached from first, every triangle of a plane
+        // lies within the tolerance of it
+        const std::size_t unassigned = std::numeric_limits<std::size_t>::max();
+        faces.triangle_planes.assign(mesh.size(), unassigned);
+        for (std::size_t seed = 0; seed < mesh.size(); ++seed) {
+            if (faces.triangle_planes[seed] != unassigned)
+                continue;
+
+            const ntriangle &s = mesh[seed];
+            const myfloat w = glm::dot(s.n, s.a);
+            auto on_plane = [&](const myvec &v) { return std::abs(glm::dot(s.n, v) - w) <= tolerance; };
+            faces.triangle_planes[seed] = faces.planes.size();
+            faces.planes.emplace_back(s.n, w);
+
+            stack.assign(1, seed);
+            while (!stack.empty()) {
+                std::size_t i = stack.back();
+                stack.pop_back();
+                for (std::size_t k = 0; k < 3; ++k) {
+                    std::size_t j = opposite[3 * i + k] / 3;
+                    const ntriangle &u = mesh[j];
+                    if (faces.triangle_planes[j] != unassigned || glm::dot(u.n, s.n) <= 0 || !on_plane(u.a) || !on_plane(u.b)
+                            || !on_plane(u.c))
+                        continue;
+                    faces.triangle_planes[j] = faces.triangle_planes[seed];
+                    stack.push_back(j);
+                }
+            }
+        }
+
+        // the edges only bound the bend between neighbours, many slightly concave edges still add up to a dent, so
+        // every vertex has to lie below every plane. the tree reorders the vertices, which are not needed afterwards
+        std::vector<vertex_node> nodes;
+        build_vertex_tree(vertices, 0, vertices.size(), nodes);
+        for (const myvec4 &plane : faces.planes) {
+            if (!below_plane(nodes, vertices, plane, tolerance)) {
+                faces = convex_faces();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void transform_faces(const mymat4 &pose, const convex_faces &faces, convex_faces &result) {
+        const mymat rotation(pose);
+        const myvec translation(pose[3]);
+        result.planes.clear();
+        for (const myvec4 &plane : faces.planes) {
+            myvec n = rotation * myvec(plane);
+            result.planes.emplace_back(n, plane.w + glm::dot(n, translation));
+        }
+        result.triangle_planes = faces.triangle_planes;
+    }
+
+    double convex_cost(std::size_t first_triangles, const convex_faces &first_faces, std::size_t second_triangles,
+                       const convex_faces &second_faces) {
+        if (first_faces.empty() && second_faces.empty())
+            return std::numeric_limits<double>::infinity();
+
+        // the sides of a convex mesh against one which is not convex cost about as much as in the pipelined engine
+        auto sides_against = [&](std::size_t triangles, std::size_t other_triangles, const convex_faces &other_faces) {
+            if (other_faces.empty())
+                return surface_triangle_cost * double(triangles + other_triangles);
+            return plane_test_cost * 3.0 * double(triangles) * double(other_faces.planes.size());
+        };
+        return sides_against(first_triangles, second_triangles, second_faces) + sides_against(second_triangles, first_triangles, first_faces);
+    }
+
+    // the planes of a convex mesh in the staged frame, with the triangles of every plane in compressed rows. only the
+    // planes are staged up front, a triangle is moved to the staged frame when a side is tested against it
+    struct staged_convex {
+        const std::vector<ntriangle> &triangles;
+        const myvec origin;
+        std::vector<myvec4> planes;
+        std::vector<std::size_t> offsets, rows;
+        // sides closer to a plane are evaluated against every triangle, this covers the faces merged into a plane
+        myfloat margin;
+
+        staged_convex(const std::vector<ntriangle> &mesh, const convex_faces &faces, const myvec &origin)
+                : triangles(mesh), origin(origin) {
+            for (const myvec4 &plane : faces.planes)
+                planes.emplace_back(myvec(plane), plane.w - glm::dot(myvec(plane), origin));
+
+            offsets.assign(planes.size() + 1, 0);
+            for (std::size_t plane : faces.triangle_planes)
+                ++offsets[plane + 1];
+            for (std::size_t j = 0; j < planes.size(); ++j)
+                offsets[j + 1] += offsets[j];
+            rows.resize(triangles.size());
+            std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i = 0; i < triangles.size(); ++i)
+                rows[fill[faces.triangle_planes[i]]++] = i;
+
+            margin = 2 * convexity_tolerance * extent(triangles);
+        }
+
+        ntriangle triangle(std::size_t i) const {
+            return relative_to(triangles[i], origin);
+        }
+
+        myfloat distance(std::size_t plane, const myvec &point) const {
+            return glm::dot(myvec(planes[plane]), point) - planes[plane].w;
+        }
+    };
+
+    // the side against every triangle of the convex mesh, like the brute force engine
+    void intersect_side(const triangle_side &side, const staged_convex &convex, eval::perturbation p, eval::term_batch &batch,
+                        eval::compensated_sum<myfloat> &accum) {
+        eval::intersection_count ic = eval::intersection_count::zero();
+        for (std::size_t i = 0; i < convex.triangles.size(); ++i) {
+            const ntriangle t = convex.triangle(i);
+            myvec intersection_point;
+            if (!eval::find_intersection(t, side, p, ic, intersection_point))
+                continue;
+            if (batch.full())
+                batch.flush(accum);
+            batch.push(intersection_point, side.end - side.start, side.n, t.n);
+        }
+        accum.add(eval::evaluate_line_intersection(side, ic));
+    }
+
+    // the part of the side inside the convex mesh, entered and left through the planes which cut it last and first.
+    // the crossings are then tested against the triangles of these planes only. returns false without generating
+    // terms if an endpoint or a crossing lies within the margin of a plane, find_crossing decides those
+    bool clip_side(const triangle_side &side, const staged_convex &convex, eval::perturbation p, eval::term_batch &batch,
+                   eval::compensated_sum<myfloat> &accum) {
+        const std::size_t none = std::numeric_limits<std::size_t>::max();
+        myfloat enter = 0, leave = 1;
+        std::size_t entered = none, left = none;
+        bool ambiguous = false;
+
+        for (std::size_t j = 0; j < convex.planes.size(); ++j) {
+            myfloat start_distance = convex.distance(j, side.start), end_distance = convex.distance(j, side.end);
+            if (start_distance > convex.margin && end_distance > convex.margin)
+                return true;
+            if (std::abs(start_distance) <= convex.margin || std::abs(end_distance) <= convex.margin) {
+                ambiguous = true;
+                continue;
+            }
+            if ((start_distance > 0) == (end_distance > 0))
+                continue;
+
+            myfloat scalar = start_distance / (start_distance - end_distance);
+            if (start_distance > 0 && (entered == none || scalar > enter)) {
+                enter = scalar;
+                entered = j;
+            } else if (start_distance < 0 && (left == none || scalar < leave)) {
+                leave = scalar;
+                left = j;
+            }
+        }
+        if (ambiguous)
+            return false;
+
+        // the line passes the mesh by, it leaves the last plane before it enters the first
+        if (enter > leave)
+            return convex.distance(left, (1 - enter) * side.start + enter * side.end) > convex.margin;
+
+        const std::size_t crossed[2] = {entered, left};
+        const myfloat scalars[2] = {enter, leave};
+        myvec points[2];
+        myvec normals[2];
+        for (std::size_t e = 0; e < 2; ++e) {
+            if (crossed[e] == none)
+                continue;
+
+            // near an edge of the mesh, the crossing may as well belong to the neighbouring plane
+            myvec point = (1 - scalars[e]) * side.start + scalars[e] * side.end;
+            for (std::size_t j = 0; j < convex.planes.size(); ++j) {
+                if (j != crossed[e] && convex.distance(j, point) >= -convex.margin)
+                    return false;
+            }
+
+            std::size_t found = 0;
+            for (std::size_t r = convex.offsets[crossed[e]]; r < convex.offsets[crossed[e] + 1]; ++r) {
+                const ntriangle t = convex.triangle(convex.rows[r]);
+                myfloat scalar;
+                if (eval::find_crossing(t, side, p, scalar) != eval::crossing::on_segment)
+                    continue;
+                points[e] = (1 - scalar) * side.start + scalar * side.end;
+                normals[e] = t.n;
+                ++found;
+            }
+            if (found != 1)
+                return false;
+        }
+
+        for (std::size_t e = 0; e < 2; ++e) {
+            if (crossed[e] == none)
+                continue;
+            if (batch.full())
+                batch.flush(accum);
+            batch.push(points[e], side.end - side.start, side.n, normals[e]);
+        }
+        accum.add(eval::evaluate_line_intersection(side, entered == none, left == none));
+        return true;
+    }
+
+    // the sides of a mesh against a convex mesh
+    eval::compensated_sum<myfloat> clip_sides(const std::vector<ntriangle> &lines, const staged_convex &convex, eval::perturbation p) {
+        return deterministic_reduce<myfloat>(lines.size(), [&](std::size_t first, std::size_t last) {
+            eval::term_batch batch;
+            eval::compensated_sum<myfloat> accum;
+
+            for (std::size_t i = first; i < last; ++i) {
+                for (std::size_t k = 0; k < 3; ++k) {
+                    triangle_side side = extract_side(lines[i], k);
+                    if (!clip_side(side, convex, p, batch, accum))
+                        intersect_side(side, convex, p, batch, accum);
+                }
+            }
+
+            batch.flush(accum);
+            return accum;
+        });
+    }
+
+    // the sides of a convex mesh against a mesh which is not convex. the crossings come from a grid over the triangles
+    // inside the box of the convex mesh, and since the convex mesh is closed and connected, its vertices are
+    // classified from a single one by the parity of the crossings along its edges
+    eval::compensated_sum<myfloat> surface_sides(const std::vector<ntriangle> &lines, const std::vector<ntriangle> &triangles,
+                                                 const std::vector<ntriangle> &clipped, const myvec &origin, eval::perturbation p) {
+        if (lines.empty())
+            return eval::compensated_sum<myfloat>();
+
+        triangle_grid grid(clipped);
+
+        std::vector<unsigned char> parity(lines.size() * 3, 0);
+        eval::compensated_sum<myfloat> terms = deterministic_reduce<myfloat>(lines.size(), [&](std::size_t first, std::size_t last) {
+            eval::term_batch batch;
+            eval::compensated_sum<myfloat> accum;
+            std::vector<std::size_t> candidates;
+
+            for (std::size_t i = first; i < last; ++i) {
+                const ntriangle &t = lines[i];
+                candidates.clear();
+                grid.query(glm::min(t.a, glm::min(t.b, t.c)), glm::max(t.a, glm::max(t.b, t.c)),
+                           [&](std::size_t triangle) { candidates.push_back(triangle); });
+
+                for (std::size_t k = 0; k < 3; ++k) {
+                    triangle_side side = extract_side(t, k);
+                    for (std::size_t candidate : candidates) {
+                        const ntriangle &u = clipped[candidate];
+                        myfloat scalar;
+                        if (eval::find_crossing(u, side, p, scalar) != eval::crossing::on_segment)
+                            continue;
+
+                        parity[3 * i + k] ^= 1;
+                        if (batch.full())
+                            batch.flush(accum);
+                        batch.push((1 - scalar) * side.start + scalar * side.end, side.end - side.start, side.n, u.n);
+                    }
+                }
+            }
+
+            batch.flush(accum);
+            return accum;
+        });
+
+        std::vector<myvec> vertices;
+        std::vector<std::size_t> indices;
+        unify_vertices(lines, vertices, indices);
+
+        // the first vertex is classified by the crossings of its side behind it, like in the brute force engine
+        bool first_inside = false;
+        triangle_side seed = extract_side(lines[0], 0);
+        for (const ntriangle &u : triangles) {
+            myfloat scalar;
+            if (eval::find_crossing(relative_to(u, origin), seed, p, scalar) == eval::crossing::before_segment)
+                first_inside = !first_inside;
+        }
+
+        // sides in compressed rows by their start vertex
+        std::vector<std::size_t> offsets(vertices.size() + 1, 0), rows(indices.size());
+        for (std::size_t c = 0; c < indices.size(); ++c)
+            ++offsets[indices[c] + 1];
+        for (std::size_t v = 0; v < vertices.size(); ++v)
+            offsets[v + 1] += offsets[v];
+        std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t c = 0; c < indices.size(); ++c)
+            rows[fill[indices[c]]++] = c;
+
+        std::vector<signed char> inside(vertices.size(), -1);
+        std::vector<std::size_t> stack(1, indices[0]);
+        inside[indices[0]] = first_inside;
+        while (!stack.empty()) {
+            std::size_t v = stack.back();
+            stack.pop_back();
+            for (std::size_t r = offsets[v]; r < offsets[v + 1]; ++r) {
+                std::size_t c = rows[r];
+                std::size_t w = indices[next_corner(c)];
+                if (inside[w] >= 0)
+                    continue;
+                inside[w] = inside[v] ^ parity[c];
+                stack.push_back(w);
+            }
+        }
+
+        for (std::size_t c = 0; c < indices.size(); ++c) {
+            bool start_inside = inside[indices[c]] == 1, end_inside = inside[indices[next_corner(c)]] == 1;
+            if (start_inside || end_inside)
+                terms.add(eval::evaluate_line_intersection(extract_side(lines[c / 3], c % 3), start_inside, end_inside));
+        }
+        return terms;
+    }
+
+    // the triangles of a mesh which reach into a box, in the staged frame
+    std::vector<ntriangle> staged_subset(const std::vector<ntriangle> &mesh, const myvec &min, const myvec &max, const myvec &origin) {
+        std::vector<ntriangle> subset;
+        for (std::size_t i : overlapping_triangles(mesh, min, max))
+            subset.push_back(relative_to(mesh[i], origin));
+        return subset;
+    }
+
+    // the sides of one mesh against the other. only the sides inside the box of a convex mesh can reach into it, but
+    // every side of a convex mesh is needed to classify its vertices
+    eval::compensated_sum<myfloat> convex_sides(const std::vector<ntriangle> &lines, const myvec &lines_min, const myvec &lines_max,
+                                                const std::vector<ntriangle> &triangles, const convex_faces &faces, const myvec &triangles_min,
+                                                const myvec &triangles_max, const myvec &origin, eval::perturbation p) {
+        if (!faces.empty())
+            return clip_sides(staged_subset(lines, triangles_min, triangles_max, origin), staged_convex(triangles, faces, origin), p);
+        return surface_sides(convert_precision<myfloat>(lines, origin), triangles, staged_subset(triangles, lines_min, lines_max, origin), origin, p);
+    }
+
+    myfloat convex_intersection_volume(const std::vector<ntriangle> &first_mesh, const convex_faces &first_faces,
+                                       const std::vector<ntriangle> &second_mesh, const convex_faces &second_faces,
+                                       myfloat *error_estimate) {
+        if (first_faces.empty() && second_faces.empty())
+            throw std::invalid_argument("Neither mesh is convex.");
+
+        myvec first_min, first_max, second_min, second_max;
+        bounding_box(first_mesh, first_min, first_max);
+        bounding_box(second_mesh, second_min, second_max);
+        myvec origin = local_origin(first_mesh, second_mesh);
+
+        eval::compensated_sum<myfloat> terms = convex_sides(first_mesh, first_min, first_max, second_mesh, second_faces, second_min,
+                                                            second_max, origin, eval::lines_of_first_mesh);
+        terms.add(convex_sides(second_mesh, second_min, second_max, first_mesh, first_faces, first_min, first_max, origin,
+                               eval::lines_of_second_mesh));
+
+        if (error_estimate)
+            *error_estimate = terms.error_estimate() / 6;
+        return terms.value() / 6;
+    }
+}
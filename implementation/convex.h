@@ -0,0 +1,46 @@
+#ifndef MI_CONVEX_H
+#define MI_CONVEX_H
+
+#include "globals.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace mesh {
+
+    // face planes of a convex mesh, empty if the mesh is not convex
+    struct convex_faces {
+        // (n, w), a point x lies inside if dot(n, x) <= w for every plane
+        std::vector<myvec4> planes;
+        // index of the plane of every triangle
+        std::vector<std::size_t> triangle_planes;
+
+        bool empty() const { return planes.empty(); }
+    };
+
+    // the mesh is convex if it is closed, consistently oriented and connected, encloses a positive volume, every
+    // edge bends outwards and every vertex lies below every face. faces which are coplanar up to the rounding of single
+    // precision input share one plane.
+    // returns false and leaves faces empty otherwise
+    bool convex_planes(const std::vector<ntriangle> &mesh, convex_faces &faces);
+
+    // the faces of a mesh moved by a rigid pose
+    void transform_faces(const mymat4 &pose, const convex_faces &faces, convex_faces &result);
+
+    // cost model in units of one (side, triangle) pair of the host brute force engine, see engine_cost. infinite if
+    // neither mesh is convex
+    double convex_cost(std::size_t first_triangles, const convex_faces &first_faces, std::size_t second_triangles,
+                       const convex_faces &second_faces);
+
+    // intersection volume where at least one mesh is convex. the sides of either mesh are clipped against the planes
+    // of a convex other mesh, which rejects most sides and leaves a single face to test for each crossing, so two
+    // convex meshes are evaluated without broadphase or point classification. sides close to a plane are evaluated
+    // against every triangle instead, so that degenerate contacts are resolved like in the other engines. the sides
+    // of a convex mesh against a mesh which is not convex go through a grid, their endpoints are classified along
+    // the edges. throws std::invalid_argument if neither mesh is convex
+    myfloat convex_intersection_volume(const std::vector<ntriangle> &first_mesh, const convex_faces &first_faces,
+                                       const std::vector<ntriangle> &second_mesh, const convex_faces &second_faces,
+                                       myfloat *error_estimate = nullptr);
+}
+
+#endif
@@ -0,0 +1,401 @@
+
+#include "classify.h"
+#include "convex.h"
+#include "engine.h"
+#include "evaluation.h"
+#include "grid.h"
+#include "localized.h"
+#include "mesh.h"
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace mesh {
+
+    // in units of one (side, triangle) pair of the host brute force engine, the host costs were measured
+    // on spheres of 40 to 5000 triangles, the device costs are rough estimates for a current desktop card
+    constexpr double brute_force_pair_cost = 1;
+    constexpr double localized_pair_cost = 1.1;
+    constexpr double pipelined_triangle_cost = 20;
+    constexpr double device_pair_cost = 0.01;
+    constexpr double device_launch_cost = 5e4;
+
+    myfloat run_brute_force(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                            const options &opts, engine_report &report) {
+        myfloat error_estimate;
+        myfloat volume = host_intersection_volume(first_mesh, second_mesh, opts.precision, &error_estimate);
+        report.error_estimate = error_estimate;
+#ifdef MI_FIXED_POINT_SUPPORTED
+        report.precision = opts.precision;
+#else
+        // the fixed point predicates need a 128 bit integer type
+        report.precision = opts.precision == precision::fixed_point ? precision::double_precision : opts.precision;
+#endif
+        return volume;
+    }
+
+    myfloat run_pipelined(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                          const options &opts, engine_report &report) {
+        myfloat volume = pipelined_intersection_volume(first_mesh, second_mesh, &report.stats, opts.traversal, opts.precision);
+        report.error_estimate = report.stats.error_estimate;
+        // the narrowphase has no integer kernels
+        report.precision = opts.precision == precision::fixed_point ? precision::double_precision : opts.precision;
+        return volume;
+    }
+
+    myfloat run_localized(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                          const options &, engine_report &report) {
+        myfloat error_estimate;
+        myfloat volume = localized_intersection_volume(first_mesh, second_mesh, &error_estimate);
+        report.error_estimate = error_estimate;
+        return volume;
+    }
+
+    myfloat run_accelerated(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                            const options &, engine_report &report) {
+        myfloat error_estimate;
+        myfloat volume = device_intersection_volume(first_mesh, second_mesh, &error_estimate);
+        report.error_estimate = error_estimate;
+        return volume;
+    }
+
+    // without prepared meshes the planes are found here, which costs about as much as the evaluation
+    myfloat run_convex(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                       const options &, engine_report &report) {
+        convex_faces first_faces, second_faces;
+        convex_planes(first_mesh, first_faces);
+        convex_planes(second_mesh, second_faces);
+
+        myfloat error_estimate;
+        myfloat volume = convex_intersection_volume(first_mesh, first_faces, second_mesh, second_faces, &error_estimate);
+        report.error_estimate = error_estimate;
+        return volume;
+    }
+
+    const std::vector<engine_info> &registered_engines() {
+        static const std::vector<engine_info> engines {
+                {engine_type::brute_force, "brute", true, true, run_brute_force},
+                {engine_type::pipelined, "pipelined", true, true, run_pipelined},
+                {engine_type::localized, "localized", true, false, run_localized},
+                {engine_type::accelerated, "accelerated", device_available(), false, run_accelerated},
+                {engine_type::convex, "convex", true, false, run_convex}
+        };
+        return engines;
+    }
+
+    const engine_info &find_engine(engine_type type) {
+        for (const auto &info : registered_engines())
+            if (info.type == type)
+                return info;
+        throw std::invalid_argument("No engine registered for this type.");
+    }
+
+    bool parse_engine(const std::string &name, engine_type &type) {
+        if (name == "auto") {
+            type = engine_type::automatic;
+            return true;
+        }
+        for (const auto &info : registered_engines()) {
+            if (name == info.name) {
+                type = info.type;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parse_precision(const std::string &name, mesh::precision &p) {
+        if (name == "single") {
+            p = precision::single_precision;
+        } else if (name == "double") {
+            p = precision::double_precision;
+        } else if (name == "mixed") {
+            p = precision::mixed_precision;
+        } else if (name == "fixed") {
+            p = precision::fixed_point;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    const char *precision_name(mesh::precision p) {
+        switch (p) {
+            case precision::single_precision:
+                return "single";
+            case precision::double_precision:
+                return "double";
+            case precision::mixed_precision:
+                return "mixed";
+            default:
+                return "fixed";
+        }
+    }
+
+    double engine_cost(engine_type type, std::size_t first_triangles, std::size_t second_triangles) {
+        double pairs = 3.0 * first_triangles * second_triangles;
+        double triangles = double(first_triangles + second_triangles);
+
+        switch (type) {
+            case engine_type::brute_force:
+                return brute_force_pair_cost * pairs;
+            // the broadphase only pays off once it can reject more pairs than it costs to set up
+            case engine_type::pipelined:
+                return pipelined_triangle_cost * triangles;
+            case engine_type::localized:
+                return localized_pair_cost * pairs;
+            case engine_type::accelerated:
+                return device_pair_cost * pairs + device_launch_cost;
+            // depends on the faces of the meshes, so it is only weighed for prepared meshes, see convex_cost
+            case engine_type::convex:
+                return std::numeric_limits<double>::infinity();
+            default:
+                return std::numeric_limits<double>::infinity();
+        }
+    }
+
+    engine_type select_engine(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, const options &opts) {
+        engine_type best = engine_type::brute_force;
+        double best_cost = std::numeric_limits<double>::infinity();
+
+        for (const auto &info : registered_engines()) {
+            // the other engines would silently ignore the requested precision
+            if (!info.available || (!info.runtime_precision && opts.precision != default_precision))
+                continue;
+
+            double cost = engine_cost(info.type, first_mesh.size(), second_mesh.size());
+            if (cost < best_cost) {
+                best = info.type;
+                best_cost = cost;
+            }
+        }
+        return best;
+    }
+
+    double estimated_cost(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, const options &opts) {
+        engine_type type = opts.engine == engine_type::automatic ? select_engine(first_mesh, second_mesh, opts) : opts.engine;
+        return engine_cost(type, first_mesh.size(), second_mesh.size());
+    }
+
+    // applies options::threads for the duration of a call
+    struct thread_scope {
+        int previous = 0;
+
+        explicit thread_scope(int threads) {
+#ifdef _OPENMP
+            if (threads > 0) {
+                previous = omp_get_max_threads();
+                omp_set_num_threads(threads);
+            }
+#else
+            (void) threads;
+#endif
+        }
+
+        ~thread_scope() {
+#ifdef _OPENMP
+            if (previous > 0)
+                omp_set_num_threads(previous);
+#endif
+        }
+    };
+
+    bool boxes_overlap(const myvec &first_min, const myvec &first_max, const myvec &second_min, const myvec &second_max) {
+        return !glm::any(glm::lessThan(first_max, second_min)) && !glm::any(glm::lessThan(second_max, first_min));
+    }
+
+    // a side of one mesh crosses a triangle of the other, both lie in the overlap of the bounding boxes
+    bool surfaces_cross(const std::vector<ntriangle> &first_mesh, const std::vector<std::size_t> &first_clipped,
+                        const std::vector<ntriangle> &second_mesh, const std::vector<std::size_t> &second_clipped) {
+        if (first_clipped.empty() || second_clipped.empty())
+            return false;
+
+        std::vector<ntriangle> second;
+        for (std::size_t i : second_clipped)
+            second.push_back(second_mesh[i]);
+        triangle_grid grid(second);
+
+        for (std::size_t i : first_clipped) {
+            const ntriangle &t = first_mesh[i];
+            bool crossing = false;
+            grid.query(glm::min(t.a, glm::min(t.b, t.c)), glm::max(t.a, glm::max(t.b, t.c)), [&](std::size_t j) {
+                const ntriangle &u = second[j];
+                myfloat scalar;
+                for (std::size_t k = 0; k < 3 && !crossing; ++k) {
+                    crossing = eval::find_crossing(u, extract_side(t, k), eval::lines_of_first_mesh, scalar) == eval::crossing::on_segment
+                            || eval::find_crossing(t, extract_side(u, k), eval::lines_of_second_mesh, scalar) == eval::crossing::on_segment;
+                }
+            });
+            if (crossing)
+                return true;
+        }
+        return false;
+    }
+
+    // without crossing surfaces every component lies entirely inside or outside the other mesh, so a single vertex
+    // classifies it. components outside the overlap of the bounding boxes are outside
+    myfloat contained_volume(const std::vector<ntriangle> &mesh, const std::vector<std::size_t> &clipped,
+                             const std::vector<ntriangle> &other, eval::perturbation p) {
+        if (clipped.empty())
+            return 0;
+
+        std::vector<std::size_t> components;
+        std::vector<char> inside(connected_components(mesh, components), -1);
+        projected_classifier classifier(other, p);
+        for (std::size_t i : clipped) {
+            char &state = inside[components[i]];
+            if (state < 0)
+                state = classifier.is_inside(mesh[i].a);
+        }
+
+        std::vector<ntriangle> contained;
+        for (std::size_t i = 0; i < mesh.size(); ++i)
+            if (inside[components[i]] == 1)
+                contained.push_back(mesh[i]);
+        return volume(contained);
+    }
+
+    // answers the query without an engine if the bounding boxes are disjoint, or if one box contains the other and
+    // the surfaces do not cross. returns false if an engine has to run
+    bool pre_classify(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, myfloat &result) {
+        result = 0;
+        if (first_mesh.empty() || second_mesh.empty())
+            return true;
+
+        myvec first_min, first_max, second_min, second_max;
+        bounding_box(first_mesh, first_min, first_max);
+        bounding_box(second_mesh, second_min, second_max);
+        if (!boxes_overlap(first_min, first_max, second_min, second_max))
+            return true;
+
+        // crossing the surfaces costs about a broadphase, so it is only worth it where one mesh may contain the other
+        bool first_nested = glm::all(glm::lessThanEqual(second_min, first_min)) && glm::all(glm::lessThanEqual(first_max, second_max));
+        bool second_nested = glm::all(glm::lessThanEqual(first_min, second_min)) && glm::all(glm::lessThanEqual(second_max, first_max));
+        if (!first_nested && !second_nested)
+            return false;
+
+        // the same coordinates as the engines, so that degenerate configurations are resolved alike
+        myvec origin = local_origin(first_mesh, second_mesh);
+        std::vector<ntriangle> first = convert_precision<myfloat>(first_mesh, origin), second = convert_precision<myfloat>(second_mesh, origin);
+        bounding_box(first, first_min, first_max);
+        bounding_box(second, second_min, second_max);
+        myvec min = glm::max(first_min, second_min), max = glm::min(first_max, second_max);
+        std::vector<std::size_t> first_clipped = overlapping_triangles(first, min, max);
+        std::vector<std::size_t> second_clipped = overlapping_triangles(second, min, max);
+
+        if (surfaces_cross(first, first_clipped, second, second_clipped))
+            return false;
+
+        result = contained_volume(first, first_clipped, second, eval::lines_of_first_mesh)
+                 + contained_volume(second, second_clipped, first, eval::lines_of_second_mesh);
+        return true;
+    }
+
+    // the faces come from prepared meshes and are empty for a mesh which is not convex
+    myfloat evaluate_query(const std::vector<ntriangle> &first_mesh, const convex_faces &first_faces,
+                           const std::vector<ntriangle> &second_mesh, const convex_faces &second_faces,
+                           const options &opts, engine_report *report) {
+        engine_report local_report;
+        engine_report &r = report ? *report : local_report;
+        r = engine_report();
+
+        r.engine = opts.engine == engine_type::automatic ? select_engine(first_mesh, second_mesh, opts) : opts.engine;
+        if (opts.engine == engine_type::automatic && opts.precision == default_precision
+                && convex_cost(first_mesh.size(), first_faces, second_mesh.size(), second_faces)
+                   < engine_cost(r.engine, first_mesh.size(), second_mesh.size()))
+            r.engine = engine_type::convex;
+        const engine_info &info = find_engine(r.engine);
+        if (!info.available)
+            throw std::invalid_argument(std::string("The ") + info.name + " engine is not available in this build.");
+        // the automatic selection never picks these, an explicit request would silently lose the precision
+        if (!info.runtime_precision && opts.precision != default_precision)
+            throw std::invalid_argument(std::string("The ") + info.name + " engine only evaluates in "
+                                        + precision_name(default_precision) + " precision.");
+
+        thread_scope threads(opts.threads);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        myfloat volume;
+        // the pre-classification evaluates in the default precision, an explicit engine or precision always runs
+        if (opts.engine == engine_type::automatic && opts.precision == default_precision
+                && pre_classify(first_mesh, second_mesh, volume)) {
+            // only the rounding of the result is reported
+            r.engine = engine_type::automatic;
+            r.error_estimate = std::numeric_limits<myfloat>::epsilon() * std::abs(volume);
+        } else if (r.engine == engine_type::convex && (!first_faces.empty() || !second_faces.empty())) {
+            myfloat error_estimate;
+            volume = convex_intersection_volume(first_mesh, first_faces, second_mesh, second_faces, &error_estimate);
+            r.error_estimate = error_estimate;
+        } else {
+            volume = info.run(first_mesh, second_mesh, opts, r);
+        }
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return volume;
+    }
+
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                const options &opts, engine_report *report) {
+        return evaluate_query(first_mesh, convex_faces(), second_mesh, convex_faces(), opts, report);
+    }
+
+    prepared_mesh prepare_mesh(const std::vector<triangle> &mesh) {
+        prepared_mesh prepared;
+        prepared.triangles = generate_normals(mesh);
+        bounding_box(mesh, prepared.min, prepared.max);
+        prepared.volume = volume(mesh);
+        convex_planes(prepared.triangles, prepared.faces);
+        return prepared;
+    }
+
+    bool bounding_boxes_overlap(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh) {
+        return boxes_overlap(first_mesh.min, first_mesh.max, second_mesh.min, second_mesh.max);
+    }
+
+    prepared_mesh prepare_mesh(const prepared_mesh &mesh, const mymat4 &transformation) {
+        std::vector<triangle> triangles(mesh.triangles.begin(), mesh.triangles.end());
+        transform(transformation, triangles);
+        return prepare_mesh(triangles);
+    }
+
+    myfloat intersection_volume(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh,
+                                const options &opts, engine_report *report) {
+        if (!bounding_boxes_overlap(first_mesh, second_mesh)) {
+            if (report)
+                *report = engine_report();
+            return 0;
+        }
+        return evaluate_query(first_mesh.triangles, first_mesh.faces, second_mesh.triangles, second_mesh.faces, opts, report);
+    }
+
+    myfloat intersection_volume(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh, const mymat4 &second_pose,
+                                const options &opts, engine_report *report) {
+        if (!is_rigid(second_pose))
+            throw std::invalid_argument("The pose is not a rigid transformation.");
+
+        myvec posed_min, posed_max;
+        transform_bounding_box(second_pose, second_mesh.min, second_mesh.max, posed_min, posed_max);
+        if (!boxes_overlap(first_mesh.min, first_mesh.max, posed_min, posed_max)) {
+            if (report)
+                *report = engine_report();
+            return 0;
+        }
+
+        // the volume does not change if both meshes are moved by the inverse pose instead
+        thread_local std::vector<ntriangle> posed;
+        thread_local convex_faces posed_faces;
+        if (second_mesh.triangles.size() <= first_mesh.triangles.size()) {
+            transform_rigid(second_pose, second_mesh.triangles, posed);
+            transform_faces(second_pose, second_mesh.faces, posed_faces);
+            return evaluate_query(first_mesh.triangles, first_mesh.faces, posed, posed_faces, opts, report);
+        }
+        mymat4 inverse = inverse_rigid(second_pose);
+        transform_rigid(inverse, first_mesh.triangles, posed);
+        transform_faces(inverse, first_mesh.faces, posed_faces);
+        return evaluate_query(posed, posed_faces, second_mesh.triangles, second_mesh.faces, opts, report);
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef MI_ENGINE_H
+#define MI_ENGINE_H
+
+#include "convex.h"
+#include "globals.h"
+#include "intersect.h"
+#include "pipeline.h"
+
+#include <string>
+#include <vector>
+
+namespace mesh {
+
+    enum class engine_type {
+        // picked per job by select_engine
+        automatic,
+        // every side against every triangle of the other mesh on the host
+        brute_force,
+        // grid broadphase followed by a narrowphase on the candidate pairs
+        pipelined,
+        // brute force, but vertex locations are propagated along the mesh instead of counted per side
+        localized,
+        // brute force on the device, only available in CUDA builds
+        accelerated,
+        // sides clipped against the face planes of a convex mesh, needs at least one convex mesh
+        convex
+    };
+
+    struct options {
+        engine_type engine = engine_type::automatic;
+        mesh::precision precision = mesh::default_precision;
+        pipeline_traversal traversal = pipeline_traversal::fused;
+        // openmp threads of the host engines, 0 keeps the runtime default and 1 runs serially
+        int threads = 0;
+    };
+
+    struct engine_report {
+        // the engine which computed the volume
+        engine_type engine = engine_type::automatic;
+        double seconds = 0;
+        // first order estimate of the rounding error of the volume, NaN if the engine does not track it
+        double error_estimate = 0;
+        // the precision the volume was evaluated in, engines without integer kernels evaluate fixed_point in double
+        mesh::precision precision = mesh::default_precision;
+        // only filled by the pipelined engine
+        pipeline_stats stats;
+    };
+
+    using engine_function = myfloat (*)(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                        const options &opts, engine_report &report);
+
+    struct engine_info {
+        engine_type type;
+        const char *name;
+        bool available;
+        // whether options::precision is honoured, the other engines always evaluate in myfloat
+        bool runtime_precision;
+        engine_function run;
+    };
+
+    // every engine compiled into this binary, including the unavailable ones
+    const std::vector<engine_info> &registered_engines();
+    const engine_info &find_engine(engine_type type);
+    bool parse_engine(const std::string &name, engine_type &type);
+    bool parse_precision(const std::string &name, mesh::precision &p);
+    const char *precision_name(mesh::precision p);
+
+    // cost model in units of one (side, triangle) pair of the host brute force engine
+    double engine_cost(engine_type type, std::size_t first_triangles, std::size_t second_triangles);
+    // cheapest available engine according to the cost model
+    engine_type select_engine(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, const options &opts);
+    // cost of the engine the options resolve to
+    double estimated_cost(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, const options &opts);
+
+    // with the automatic engine and the default precision, disjoint bounding boxes, and nested boxes whose surfaces do
+    // not cross, are answered without running an engine, report->engine is automatic then. throws
+    // std::invalid_argument if the requested engine is not available in this build, or if it does not honour a
+    // precision other than the default
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                const options &opts, engine_report *report = nullptr);
+
+    // everything about a mesh that does not depend on the other mesh of a query, kept across queries
+    struct prepared_mesh {
+        std::vector<ntriangle> triangles;
+        myvec min, max;
+        myfloat volume = 0;
+        // empty unless the mesh is convex
+        convex_faces faces;
+    };
+
+    prepared_mesh prepare_mesh(const std::vector<triangle> &mesh);
+    prepared_mesh prepare_mesh(const prepared_mesh &mesh, const mymat4 &transformation);
+
+    // touching boxes overlap, empty meshes overlap nothing
+    bool bounding_boxes_overlap(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh);
+
+    // meshes with disjoint bounding boxes are answered without running an engine, report->engine is automatic then.
+    // if either mesh is convex, the automatic selection also weighs the convex engine with the faces of the meshes
+    myfloat intersection_volume(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh,
+                                const options &opts, engine_report *report = nullptr);
+
+    // the second mesh placed at a rigid pose. only the smaller mesh is moved, in a single pass into a per-thread
+    // buffer, neither mesh is prepared again. throws std::invalid_argument if the pose is not rigid
+    myfloat intersection_volume(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh, const mymat4 &second_pose,
+                                const options &opts, engine_report *report = nullptr);
+}
+
+#endif
@@ -3,6 +3,10 @@
 
 #include "globals.h"
 
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
 namespace eval {
 
 struct intersection_count {
@@ -11,20 +15,171 @@ struct intersection_count {
     MI_SHARED static intersection_count zero() { return {}; }
 };
 
+// simulation of simplicity translates the second mesh by the infinitesimal (e, e^2, e^3), so relative to the triangles
+// they are tested against, lines (and points) of the second mesh move by +delta and those of the first mesh by -delta
+enum perturbation : int {
+    lines_of_first_mesh = -1,
+    lines_of_second_mesh = 1
+};
+
+// position of the crossing of a line and a triangle relative to the segment on the line
+enum class crossing {
+    none,
+    before_segment,
+    on_segment,
+    after_segment
+};
+
 struct localized_intersection_count {
     int on_segment = 0;
-    bool is_start_inside = false;
-    myfloat closest_point = std::numeric_limits<myfloat>::infinity();
+    int before_segment = 0;
+    // bounds on the position of the first crossing entering (0) and leaving (1) the other mesh
+    myfloat first_lower[2] = {std::numeric_limits<myfloat>::infinity(), std::numeric_limits<myfloat>::infinity()};
+    myfloat first_upper[2] = {std::numeric_limits<myfloat>::infinity(), std::numeric_limits<myfloat>::infinity()};
     MI_SHARED static localized_intersection_count zero() { return {}; }
+
+    // the start lies inside if the first crossing leaves the other mesh. crossings too close to be ordered by their
+    // rounded positions fall back to the parity of the crossings before the segment
+    MI_SHARED bool is_start_inside() const {
+        if (first_upper[1] < first_lower[0])
+            return true;
+        if (first_upper[0] < first_lower[1])
+            return false;
+        return before_segment % 2 == 1;
+    }
+};
+
+// compensated summation (Neumaier), the rounding error of every addition is carried along
+template <typename float_t>
+struct compensated_sum {
+    float_t sum = 0;
+    float_t compensation = 0;
+    // sum of the absolute values of all summands
+    float_t magnitude = 0;
+
+    MI_SHARED void add(float_t value) {
+        accumulate(value);
+        magnitude += std::abs(value);
+    }
+
+    MI_SHARED void add(const compensated_sum &other) {
+        accumulate(other.sum);
+        compensation += other.compensation;
+        magnitude += other.magnitude;
+    }
+
+    MI_SHARED float_t value() const { return sum + compensation; }
+
+    // first order estimate, the summation itself is exact up to one rounding
+    // but every summand is assumed to carry a relative error of a few ulps
+    MI_SHARED float_t error_estimate() const { return 4 * std::numeric_limits<float_t>::epsilon() * magnitude; }
+
+private:
+    MI_SHARED void accumulate(float_t value) {
+        float_t next = sum + value;
+        if (std::abs(sum) >= std::abs(value))
+            compensation += (sum - next) + value;
+        else
+            compensation += (value - next) + sum;
+        sum = next;
+    }
 };
 
-MI_SHARED bool solve_intersection(const triangle &t, const line &l, myfloat &scalar);
-MI_SHARED myvec face_same_direction(const myvec &reference, const myvec &target);
-MI_SHARED myfloat evaluate_term(const myvec &p, const myvec &t, const myvec &u, const myvec &n);
-MI_SHARED myfloat intersect_line_triangle(const ntriangle &t, const triangle_side &ts, intersection_count &ic);
-MI_SHARED myfloat local_intersect_line_triangle(const ntriangle &t, const triangle_side &ts, localized_intersection_count &ic);
-MI_SHARED myfloat evaluate_line_intersection(const triangle_side &ts, bool start_inside, bool end_inside);
-MI_SHARED myfloat evaluate_line_intersection(const triangle_side &ts, const intersection_count &ic);
+// structure of arrays buffer of intersection points, the terms of all points are evaluated in one vectorized sweep
+template <typename float_t>
+struct basic_term_batch {
+    static constexpr std::size_t capacity = 256;
+
+    std::size_t size = 0;
+    float_t px[capacity], py[capacity], pz[capacity];
+    float_t dx[capacity], dy[capacity], dz[capacity];
+    float_t lx[capacity], ly[capacity], lz[capacity];
+    float_t tx[capacity], ty[capacity], tz[capacity];
+    float_t terms[capacity];
+
+    bool full() const { return size == capacity; }
+    void push(const basic_vec<float_t> &intersection_point, const basic_vec<float_t> &line_direction,
+              const basic_vec<float_t> &line_normal, const basic_vec<float_t> &triangle_normal);
+    // evaluates the batch into accum and clears it
+    void flush(compensated_sum<float_t> &accum);
+};
+
+using term_batch = basic_term_batch<myfloat>;
+
+// derivative of the volume with respect to a rigid motion of one mesh, collected from the terms on the faces of that
+// mesh: area is the vector area of its faces inside the other mesh, moment the integral of x cross n over them
+template <typename float_t>
+struct basic_pose_gradient {
+    basic_vec<float_t> area = basic_vec<float_t>(0);
+    basic_vec<float_t> moment = basic_vec<float_t>(0);
+
+    MI_SHARED void add(const basic_pose_gradient &other) {
+        area += other.area;
+        moment += other.moment;
+    }
+
+    // same frame as evaluate_term, the face of the term is the one with normal n
+    MI_SHARED void add_term(const basic_vec<float_t> &p, const basic_vec<float_t> &t, const basic_vec<float_t> &u, const basic_vec<float_t> &n);
+};
+
+using pose_gradient = basic_pose_gradient<myfloat>;
+
+// exact signs of component i of (u1 - u0) x (v1 - v0) and of dot(d1 - d0, (u1 - u0) x (v1 - v0))
+template <typename float_t>
+MI_SHARED_KERNEL int cross_sign(const basic_vec<float_t> &u1, const basic_vec<float_t> &u0, const basic_vec<float_t> &v1, const basic_vec<float_t> &v0, int i);
+template <typename float_t>
+MI_SHARED_KERNEL int triple_sign(const basic_vec<float_t> &d1, const basic_vec<float_t> &d0, const basic_vec<float_t> &u1, const basic_vec<float_t> &u0,
+                                 const basic_vec<float_t> &v1, const basic_vec<float_t> &v0);
+template <typename float_t>
+MI_SHARED int plane_side(const basic_triangle<float_t> &t, const basic_vec<float_t> &point, perturbation p);
+template <typename float_t>
+MI_SHARED crossing find_crossing(const basic_triangle<float_t> &t, const basic_line<float_t> &l, perturbation p, float_t &scalar);
+template <typename float_t>
+MI_SHARED_KERNEL bool certainly_misses(const basic_vec<float_t> &a, const basic_vec<float_t> &b, const basic_vec<float_t> &c,
+                                       const basic_vec<float_t> &origin, const basic_vec<float_t> &d);
+template <typename float_t>
+MI_SHARED bool find_intersection(const basic_ntriangle<float_t> &t, const basic_triangle_side<float_t> &ts, perturbation p, intersection_count &ic,
+                                 basic_vec<float_t> &intersection_point);
+template <typename float_t>
+MI_SHARED basic_vec<float_t> face_same_direction(const basic_vec<float_t> &reference, const basic_vec<float_t> &target);
+template <typename float_t>
+MI_SHARED float_t evaluate_term(const basic_vec<float_t> &p, const basic_vec<float_t> &t, const basic_vec<float_t> &u, const basic_vec<float_t> &n);
+template <typename float_t>
+MI_SHARED float_t intersect_line_triangle(const basic_ntriangle<float_t> &t, const basic_triangle_side<float_t> &ts, perturbation p, intersection_count &ic);
+// bound on the rounding error of the scalar of find_crossing, from the bounds of the plane distances of both endpoints
+MI_SHARED myfloat crossing_error(const ntriangle &t, const line &l);
+MI_SHARED myfloat local_intersect_line_triangle(const ntriangle &t, const triangle_side &ts, perturbation p, localized_intersection_count &ic);
+template <typename float_t>
+MI_SHARED float_t evaluate_line_intersection(const basic_triangle_side<float_t> &ts, bool start_inside, bool end_inside);
+template <typename float_t>
+MI_SHARED float_t evaluate_line_intersection(const basic_triangle_side<float_t> &ts, const intersection_count &ic);
+// terms for a point where the faces of three meshes meet, the corner is the intersection of the three half-spaces
+template <typename float_t>
+MI_SHARED float_t generate_triple_terms(const basic_vec<float_t> &point, const basic_vec<float_t> &first_normal,
+                                        const basic_vec<float_t> &second_normal, const basic_vec<float_t> &third_normal);
+// the terms of generate_intersection_terms and evaluate_line_intersection which lie on faces of the moving mesh
+template <typename float_t>
+MI_SHARED void intersection_gradient(basic_pose_gradient<float_t> &gradient, const basic_vec<float_t> &intersection_point,
+                                     const basic_vec<float_t> &line_direction, const basic_vec<float_t> &line_normal,
+                                     const basic_vec<float_t> &triangle_normal, bool line_moves);
+template <typename float_t>
+MI_SHARED void endpoint_gradient(basic_pose_gradient<float_t> &gradient, const basic_triangle_side<float_t> &ts, bool start_inside, bool end_inside);
+
+#ifdef __SIZEOF_INT128__
+// integer coordinates of at most fixed_point_bits bits, differences and cross products fit into 64 bits
+// and the triple products into 128 bits, so all predicates are exact
+#define MI_FIXED_POINT_SUPPORTED
+constexpr int fixed_point_bits = 29;
+
+using wide_int = __int128;
+using fixed_vec = basic_vec<std::int64_t>;
+using fixed_triangle = basic_triangle<std::int64_t>;
+using fixed_line = basic_line<std::int64_t>;
+
+fixed_line extract_side(const fixed_triangle &t, std::size_t index);
+int perturbed_sign(wide_int value, const fixed_vec &perturbation);
+crossing find_crossing(const fixed_triangle &t, const fixed_line &l, perturbation p, double &scalar);
+#endif
 }
 
 #include "impl/evaluation.inl"
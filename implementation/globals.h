@@ -18,59 +18,99 @@
 
 #define MI_SHARED MI_DEVICE MI_HOST inline
 
+// kernels called from vectorized loops, the loops only vectorize if the kernel is inlined
+#if defined(MI_CUDA_ENABLED)
+#   define MI_FORCE_INLINE __forceinline__
+#elif defined(_MSC_VER)
+#   define MI_FORCE_INLINE __forceinline
+#else
+#   define MI_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+#define MI_SHARED_KERNEL MI_DEVICE MI_HOST MI_FORCE_INLINE
+
+// rare slow paths, kept out of line so that the fast path around them stays small enough to inline
+#if defined(MI_CUDA_ENABLED)
+#   define MI_NOINLINE __noinline__
+#elif defined(_MSC_VER)
+#   define MI_NOINLINE __declspec(noinline)
+#else
+#   define MI_NOINLINE __attribute__((noinline))
+#endif
+
+#define MI_SHARED_SLOW_PATH MI_DEVICE MI_HOST MI_NOINLINE
+
 #ifdef MI_SINGLE_PRECISION
 using myfloat = float;
 #else
 using myfloat = double;
 #endif
 
-using myvec = glm::vec<3, myfloat, glm::highp>;
+template <typename float_t>
+using basic_vec = glm::vec<3, float_t, glm::highp>;
+
+using myvec = basic_vec<myfloat>;
 using myvec4 = glm::vec<4, myfloat, glm::highp>;
 using mymat = glm::mat<3, 3, myfloat, glm::highp>;
 using mymat4 = glm::mat<4, 4, myfloat, glm::highp>;
 
-struct triangle {
-    myvec a;
-    myvec b;
-    myvec c;
-    MI_SHARED triangle(const myvec &a, const myvec &b, const myvec &c) : a(a), b(b), c(c) {}
+template <typename float_t>
+struct basic_triangle {
+    basic_vec<float_t> a;
+    basic_vec<float_t> b;
+    basic_vec<float_t> c;
+    MI_SHARED basic_triangle(const basic_vec<float_t> &a, const basic_vec<float_t> &b, const basic_vec<float_t> &c) : a(a), b(b), c(c) {}
 };
 
-inline myvec *begin(triangle &t) {
+template <typename float_t>
+inline basic_vec<float_t> *begin(basic_triangle<float_t> &t) {
     return &t.a;
 }
-inline const myvec *begin(const triangle &t) {
+template <typename float_t>
+inline const basic_vec<float_t> *begin(const basic_triangle<float_t> &t) {
     return &t.a;
 }
 
-inline myvec *end(triangle &t) {
+template <typename float_t>
+inline basic_vec<float_t> *end(basic_triangle<float_t> &t) {
     return begin(t) + 3;
 }
-inline const myvec *end(const triangle &t) {
+template <typename float_t>
+inline const basic_vec<float_t> *end(const basic_triangle<float_t> &t) {
     return begin(t) + 3;
 }
 
 
-struct ntriangle : public triangle {
-    myvec n;
-    MI_SHARED ntriangle(const myvec &a, const myvec &b, const myvec &c, const myvec &n) : triangle(a, b, c), n(n) {}
+template <typename float_t>
+struct basic_ntriangle : public basic_triangle<float_t> {
+    basic_vec<float_t> n;
+    MI_SHARED basic_ntriangle(const basic_vec<float_t> &a, const basic_vec<float_t> &b, const basic_vec<float_t> &c, const basic_vec<float_t> &n)
+            : basic_triangle<float_t>(a, b, c), n(n) {}
 };
 
-struct line {
-    myvec start;
-    myvec end;
-    MI_SHARED line(const myvec &start, const myvec &end) : start(start), end(end) {}
+template <typename float_t>
+struct basic_line {
+    basic_vec<float_t> start;
+    basic_vec<float_t> end;
+    MI_SHARED basic_line(const basic_vec<float_t> &start, const basic_vec<float_t> &end) : start(start), end(end) {}
 };
 
-struct triangle_side : public line {
-    myvec third;
-    myvec n;
-    MI_SHARED triangle_side(const myvec &start, const myvec &end, const myvec &third, const myvec &n)
-            : line(start, end), third(third), n(n) {}
+template <typename float_t>
+struct basic_triangle_side : public basic_line<float_t> {
+    basic_vec<float_t> third;
+    basic_vec<float_t> n;
+    MI_SHARED basic_triangle_side(const basic_vec<float_t> &start, const basic_vec<float_t> &end, const basic_vec<float_t> &third, const basic_vec<float_t> &n)
+            : basic_line<float_t>(start, end), third(third), n(n) {}
 };
 
+using triangle = basic_triangle<myfloat>;
+using ntriangle = basic_ntriangle<myfloat>;
+using line = basic_line<myfloat>;
+using triangle_side = basic_triangle_side<myfloat>;
+
+template <typename float_t>
 MI_SHARED
-triangle_side extract_side(const ntriangle &t, std::size_t index) {
+basic_triangle_side<float_t> extract_side(const basic_ntriangle<float_t> &t, std::size_t index) {
     switch (index % 3) {
         case 0:
             return {t.a, t.b, t.c, t.n};
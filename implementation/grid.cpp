@@ -0,0 +1,72 @@
+
+#include "grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace mesh {
+
+    triangle_grid::triangle_grid(const std::vector<ntriangle> &mesh) {
+        bounds_min = myvec(std::numeric_limits<myfloat>::infinity());
+        bounds_max = myvec(-std::numeric_limits<myfloat>::infinity());
+
+        triangle_min.reserve(mesh.size());
+        triangle_max.reserve(mesh.size());
+        for (const auto &t : mesh) {
+            triangle_min.push_back(glm::min(t.a, glm::min(t.b, t.c)));
+            triangle_max.push_back(glm::max(t.a, glm::max(t.b, t.c)));
+            bounds_min = glm::min(bounds_min, triangle_min.back());
+            bounds_max = glm::max(bounds_max, triangle_max.back());
+        }
+
+        if (mesh.empty()) {
+            bounds_min = bounds_max = myvec(0);
+        }
+
+        // aim for roughly one triangle per cell, distributed according to the extent along each axis,
+        // flat axes are widened so that they do not blow up the cell count of the others
+        constexpr myfloat max_cells = 256;
+        myvec extent = glm::max(bounds_max - bounds_min, myvec(std::numeric_limits<myfloat>::min()));
+        myvec sizing = glm::max(extent, myvec(std::max({extent.x, extent.y, extent.z}) / max_cells));
+        myfloat cell_size = std::cbrt(sizing.x * sizing.y * sizing.z / std::max(myfloat(1), myfloat(mesh.size())));
+        // the volume of an empty or point-like mesh underflows, it gets a single cell
+        if (!(cell_size > 0))
+            cell_size = std::numeric_limits<myfloat>::infinity();
+
+        for (int axis = 0; axis < 3; ++axis) {
+            myfloat count = std::ceil(extent[axis] / cell_size);
+            cells[axis] = (std::size_t) std::max(myfloat(1), std::min(max_cells, count));
+            inv_cell_size[axis] = cells[axis] / extent[axis];
+        }
+
+        // count triangles per cell, then scatter into the compressed layout
+        cell_offsets.assign(cells.x * cells.y * cells.z + 1, 0);
+        auto for_each_cell = [&](std::size_t triangle, auto &&action) {
+            glm::tvec3<std::size_t> first = cell(triangle_min[triangle]), last = cell(triangle_max[triangle]);
+            for (std::size_t z = first.z; z <= last.z; ++z)
+                for (std::size_t y = first.y; y <= last.y; ++y)
+                    for (std::size_t x = first.x; x <= last.x; ++x)
+                        action((z * cells.y + y) * cells.x + x);
+        };
+
+        for (std::size_t i = 0; i < mesh.size(); ++i)
+            for_each_cell(i, [&](std::size_t index) { cell_offsets[index + 1] += 1; });
+        for (std::size_t i = 1; i < cell_offsets.size(); ++i)
+            cell_offsets[i] += cell_offsets[i - 1];
+
+        cell_triangles.resize(cell_offsets.back());
+        std::vector<std::size_t> fill(cell_offsets.begin(), cell_offsets.end() - 1);
+        for (std::size_t i = 0; i < mesh.size(); ++i)
+            for_each_cell(i, [&](std::size_t index) { cell_triangles[fill[index]++] = i; });
+    }
+
+    glm::tvec3<std::size_t> triangle_grid::cell(const myvec &point) const {
+        glm::tvec3<std::size_t> result;
+        for (int axis = 0; axis < 3; ++axis) {
+            myfloat offset = (point[axis] - bounds_min[axis]) * inv_cell_size[axis];
+            result[axis] = (std::size_t) std::min(std::max(offset, myfloat(0)), myfloat(cells[axis] - 1));
+        }
+        return result;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef MI_GRID_H
+#define MI_GRID_H
+
+#include "globals.h"
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+namespace mesh {
+
+    // uniform grid over the bounding boxes of a triangle mesh
+    class triangle_grid {
+    public:
+        explicit triangle_grid(const std::vector<ntriangle> &mesh);
+
+        // visits the index of every triangle whose bounding box overlaps [min, max] exactly once
+        template <typename visitor_t>
+        void query(const myvec &min, const myvec &max, visitor_t &&visit) const;
+
+        const myvec &min() const { return bounds_min; }
+        const myvec &max() const { return bounds_max; }
+        std::size_t size() const { return triangle_min.size(); }
+
+    private:
+        glm::tvec3<std::size_t> cell(const myvec &point) const;
+
+        myvec bounds_min, bounds_max;
+        myvec inv_cell_size;
+        glm::tvec3<std::size_t> cells;
+        // compressed cell layout, triangles of cell i are cell_triangles[cell_offsets[i] .. cell_offsets[i + 1]]
+        std::vector<std::size_t> cell_offsets;
+        std::vector<std::size_t> cell_triangles;
+        std::vector<myvec> triangle_min;
+        std::vector<myvec> triangle_max;
+    };
+
+    template <typename visitor_t>
+    void triangle_grid::query(const myvec &min, const myvec &max, visitor_t &&visit) const {
+        if (glm::any(glm::greaterThan(min, bounds_max)) || glm::any(glm::lessThan(max, bounds_min)))
+            return;
+
+        glm::tvec3<std::size_t> first = cell(min), last = cell(max);
+        for (std::size_t z = first.z; z <= last.z; ++z) {
+            for (std::size_t y = first.y; y <= last.y; ++y) {
+                for (std::size_t x = first.x; x <= last.x; ++x) {
+                    std::size_t index = (z * cells.y + y) * cells.x + x;
+                    for (std::size_t i = cell_offsets[index]; i < cell_offsets[index + 1]; ++i) {
+                        std::size_t triangle = cell_triangles[i];
+                        const myvec &tmin = triangle_min[triangle], &tmax = triangle_max[triangle];
+
+                        if (glm::any(glm::greaterThan(min, tmax)) || glm::any(glm::lessThan(max, tmin)))
+                            continue;
+
+                        // report each triangle only in the first cell shared by both boxes
+                        glm::tvec3<std::size_t> reference = glm::max(first, cell(tmin));
+                        if (reference.x != x || reference.y != y || reference.z != z)
+                            continue;
+
+                        visit(triangle);
+                    }
+                }
+            }
+        }
+    }
+}
+
+#endif
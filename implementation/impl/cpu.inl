@@ -2,42 +2,308 @@
 #include "../evaluation.h"
 #include "../globals.h"
 #include "../intersect.h"
+#include "../mesh.h"
+#include "../reduction.h"
+#include "../workspace.h"
 
 #include <algorithm>
+#include <cmath>
 #include <numeric>
+#include <type_traits>
 
 #include "../glm/glm.hpp"
 
 namespace mesh {
 namespace impl {
 
-    myfloat intersect_line_all_triangles(const std::vector<ntriangle> &triangles, const triangle_side &line) {
-        myfloat accum = 0;
+    template <typename float_t>
+    void intersect_line_all_triangles(const std::vector<basic_ntriangle<float_t>> &triangles, const basic_triangle_side<float_t> &line, eval::perturbation p,
+                                      eval::basic_term_batch<float_t> &batch, eval::compensated_sum<float_t> &accum) {
         eval::intersection_count ic = eval::intersection_count::zero();
 
         for (const auto &triangle : triangles) {
-            accum += eval::intersect_line_triangle(triangle, line, ic);
+            basic_vec<float_t> isp;
+            if (!eval::find_intersection(triangle, line, p, ic, isp))
+                continue;
+
+            if (batch.full())
+                batch.flush(accum);
+            batch.push(isp, line.end - line.start, line.n, triangle.n);
+        }
+
+        accum.add(eval::evaluate_line_intersection(line, ic));
+    }
+
+    // the line is given relative to the origin, the triangles are translated on the fly like in the localized engine
+    inline void intersect_line_all_triangles(const std::vector<ntriangle> &triangles, const myvec &origin, const triangle_side &line,
+                                             eval::perturbation p, eval::basic_term_batch<myfloat> &batch, eval::compensated_sum<myfloat> &accum) {
+        eval::intersection_count ic = eval::intersection_count::zero();
+
+        for (const auto &triangle : triangles) {
+            ntriangle local = relative_to(triangle, origin);
+            myvec isp;
+            if (!eval::find_intersection(local, line, p, ic, isp))
+                continue;
+
+            if (batch.full())
+                batch.flush(accum);
+            batch.push(isp, line.end - line.start, line.n, local.n);
         }
 
-        accum += eval::evaluate_line_intersection(line, ic);
-        return accum;
+        accum.add(eval::evaluate_line_intersection(line, ic));
     }
 
-    myfloat asymetric_intersect(const std::vector<ntriangle> &triangles, const std::vector<ntriangle> &lines) {
-        myfloat accum = 0;
+    // float copy of a mesh in structure of arrays layout, a side is filtered against a block of triangles in one sweep
+    struct filter_mesh {
+        std::vector<float> ax, ay, az;
+        std::vector<float> bx, by, bz;
+        std::vector<float> cx, cy, cz;
+
+        explicit filter_mesh(const std::vector<basic_ntriangle<double>> &mesh) {
+            for (const auto &t : mesh) {
+                basic_vec<float> a(t.a), b(t.b), c(t.c);
+                ax.push_back(a.x), ay.push_back(a.y), az.push_back(a.z);
+                bx.push_back(b.x), by.push_back(b.y), bz.push_back(b.z);
+                cx.push_back(c.x), cy.push_back(c.y), cz.push_back(c.z);
+            }
+        }
+    };
+
+    constexpr std::size_t filter_block_size = 256;
+
+    // the float filter only rejects pairs which certainly do not cross, the remaining pairs are solved again in double
+    void mixed_intersect_line_all_triangles(const filter_mesh &filter, const std::vector<basic_ntriangle<double>> &triangles,
+                                            const basic_triangle_side<double> &line, eval::perturbation p, eval::basic_term_batch<double> &batch,
+                                            eval::compensated_sum<double> &accum) {
+        eval::intersection_count ic = eval::intersection_count::zero();
+
+        const float sx = (float) line.start.x, sy = (float) line.start.y, sz = (float) line.start.z;
+        const float dx = (float) (line.end.x - line.start.x), dy = (float) (line.end.y - line.start.y), dz = (float) (line.end.z - line.start.z);
+        const float *ax = filter.ax.data(), *ay = filter.ay.data(), *az = filter.az.data();
+        const float *bx = filter.bx.data(), *by = filter.by.data(), *bz = filter.bz.data();
+        const float *cx = filter.cx.data(), *cy = filter.cy.data(), *cz = filter.cz.data();
+        unsigned char survivors[filter_block_size];
+
+        for (std::size_t first = 0; first < triangles.size(); first += filter_block_size) {
+            const std::size_t count = std::min(filter_block_size, triangles.size() - first);
 
-        // proof-of-concept openmp support (requires signed variables / msvc does not support collapse)
-        #pragma omp parallel for reduction(+:accum)
-        for (std::int64_t i = 0; std::size_t(i) < lines.size() * 3; ++i) {
-            const std::int64_t tri = i / 3;
-            const std::int64_t line = i % 3;
-            accum += intersect_line_all_triangles(triangles, extract_side(lines[tri], (std::size_t) line));
+            // branch-free, so the compiler can vectorize the sweep
+            for (std::size_t j = 0; j < count; ++j) {
+                const std::size_t i = first + j;
+                survivors[j] = !eval::certainly_misses(basic_vec<float>(ax[i], ay[i], az[i]), basic_vec<float>(bx[i], by[i], bz[i]),
+                                                       basic_vec<float>(cx[i], cy[i], cz[i]), basic_vec<float>(sx, sy, sz),
+                                                       basic_vec<float>(dx, dy, dz));
+            }
+
+            for (std::size_t j = 0; j < count; ++j) {
+                basic_vec<double> isp;
+                if (!survivors[j] || !eval::find_intersection(triangles[first + j], line, p, ic, isp))
+                    continue;
+
+                if (batch.full())
+                    batch.flush(accum);
+                batch.push(isp, line.end - line.start, line.n, triangles[first + j].n);
+            }
         }
-        return accum;
+
+        accum.add(eval::evaluate_line_intersection(line, ic));
+    }
+
+    template <typename float_t>
+    eval::compensated_sum<float_t> asymetric_intersect(const std::vector<basic_ntriangle<float_t>> &triangles,
+                                                       const std::vector<basic_ntriangle<float_t>> &lines, eval::perturbation p,
+                                                       std::vector<eval::compensated_sum<float_t>> &partial) {
+        return deterministic_reduce<float_t>(lines.size() * 3, [&](std::size_t first, std::size_t last) {
+            // intersection terms are collected per block and evaluated in batches
+            eval::basic_term_batch<float_t> batch;
+            eval::compensated_sum<float_t> accum;
+
+            for (std::size_t i = first; i < last; ++i)
+                intersect_line_all_triangles(triangles, extract_side(lines[i / 3], i % 3), p, batch, accum);
+
+            batch.flush(accum);
+            return accum;
+        }, partial);
+    }
+
+    inline eval::compensated_sum<myfloat> asymetric_intersect(const std::vector<ntriangle> &triangles, const std::vector<ntriangle> &lines,
+                                                              const myvec &origin, eval::perturbation p) {
+        return deterministic_reduce<myfloat>(lines.size() * 3, [&](std::size_t first, std::size_t last) {
+            eval::basic_term_batch<myfloat> batch;
+            eval::compensated_sum<myfloat> accum;
+
+            for (std::size_t i = first; i < last; ++i)
+                intersect_line_all_triangles(triangles, origin, extract_side(relative_to(lines[i / 3], origin), i % 3), p, batch, accum);
+
+            batch.flush(accum);
+            return accum;
+        });
+    }
+
+    eval::compensated_sum<double> mixed_asymetric_intersect(const filter_mesh &filter, const std::vector<basic_ntriangle<double>> &triangles,
+                                                            const std::vector<basic_ntriangle<double>> &lines, eval::perturbation p) {
+        return deterministic_reduce<double>(lines.size() * 3, [&](std::size_t first, std::size_t last) {
+            eval::basic_term_batch<double> batch;
+            eval::compensated_sum<double> accum;
+
+            for (std::size_t i = first; i < last; ++i)
+                mixed_intersect_line_all_triangles(filter, triangles, extract_side(lines[i / 3], i % 3), p, batch, accum);
+
+            batch.flush(accum);
+            return accum;
+        });
     }
 
-    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh) {
-        return (asymetric_intersect(first_mesh, second_mesh) + asymetric_intersect(second_mesh, first_mesh)) / 6;
+#ifdef MI_FIXED_POINT_SUPPORTED
+    // a mesh snapped to the integer grid, with the snapped vertices in double for the term evaluation
+    struct fixed_mesh {
+        std::vector<eval::fixed_triangle> triangles;
+        std::vector<basic_ntriangle<double>> snapped;
+
+        fixed_mesh(const std::vector<ntriangle> &mesh, const myvec &origin, double scale) {
+            triangles.reserve(mesh.size());
+            snapped.reserve(mesh.size());
+
+            auto snap = [&](const myvec &vertex) {
+                basic_vec<double> local = glm::round(basic_vec<double>(vertex - origin) * scale);
+                return eval::fixed_vec(local);
+            };
+            for (const auto &t : mesh) {
+                triangles.emplace_back(snap(t.a), snap(t.b), snap(t.c));
+                const eval::fixed_triangle &f = triangles.back();
+                // grid points are exactly representable in double
+                snapped.emplace_back(basic_vec<double>(f.a) / scale, basic_vec<double>(f.b) / scale, basic_vec<double>(f.c) / scale,
+                                     basic_vec<double>(t.n));
+            }
+        }
+    };
+
+    // finest power of two scale that keeps every vertex within the integer range of the exact predicates
+    double fixed_point_scale(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, const myvec &origin) {
+        myfloat largest = 0;
+        for (const auto *mesh : {&first_mesh, &second_mesh})
+            for (const auto &t : *mesh)
+                for (const auto &vertex : t) {
+                    myvec distance = glm::abs(vertex - origin);
+                    largest = std::max({largest, distance.x, distance.y, distance.z});
+                }
+
+        double limit = std::ldexp(1.0, eval::fixed_point_bits) - 1;
+        return largest > 0 ? std::exp2(std::floor(std::log2(limit / double(largest)))) : 1;
+    }
+
+    void fixed_intersect_line_all_triangles(const fixed_mesh &triangles, const fixed_mesh &lines, std::size_t side, eval::perturbation p,
+                                            eval::basic_term_batch<double> &batch, eval::compensated_sum<double> &accum) {
+        eval::intersection_count ic = eval::intersection_count::zero();
+
+        const eval::fixed_line fixed_line = eval::extract_side(lines.triangles[side / 3], side % 3);
+        const basic_triangle_side<double> line = extract_side(lines.snapped[side / 3], side % 3);
+
+        for (std::size_t i = 0; i < triangles.triangles.size(); ++i) {
+            double scalar;
+            eval::crossing c = eval::find_crossing(triangles.triangles[i], fixed_line, p, scalar);
+
+            if (c == eval::crossing::before_segment)
+                ic.before_segment += 1;
+            if (c != eval::crossing::on_segment)
+                continue;
+
+            ic.on_segment += 1;
+            if (batch.full())
+                batch.flush(accum);
+            batch.push((1 - scalar) * line.start + scalar * line.end, line.end - line.start, line.n, triangles.snapped[i].n);
+        }
+
+        accum.add(eval::evaluate_line_intersection(line, ic));
+    }
+
+    eval::compensated_sum<double> fixed_asymetric_intersect(const fixed_mesh &triangles, const fixed_mesh &lines, eval::perturbation p) {
+        return deterministic_reduce<double>(lines.triangles.size() * 3, [&](std::size_t first, std::size_t last) {
+            eval::basic_term_batch<double> batch;
+            eval::compensated_sum<double> accum;
+
+            for (std::size_t i = first; i < last; ++i)
+                fixed_intersect_line_all_triangles(triangles, lines, i, p, batch, accum);
+
+            batch.flush(accum);
+            return accum;
+        });
+    }
+#endif
+
+    template <typename float_t>
+    eval::compensated_sum<float_t> intersection_terms(const std::vector<basic_ntriangle<float_t>> &first_mesh,
+                                                      const std::vector<basic_ntriangle<float_t>> &second_mesh) {
+        std::vector<eval::compensated_sum<float_t>> partial;
+        eval::compensated_sum<float_t> terms = asymetric_intersect(first_mesh, second_mesh, eval::lines_of_second_mesh, partial);
+        terms.add(asymetric_intersect(second_mesh, first_mesh, eval::lines_of_first_mesh, partial));
+        return terms;
+    }
+
+    template <typename float_t>
+    myfloat volume_of(const eval::compensated_sum<float_t> &terms, myfloat *error_estimate) {
+        if (error_estimate)
+            *error_estimate = (myfloat) (terms.error_estimate() / 6);
+        return (myfloat) (terms.value() / 6);
+    }
+
+    // in the precision of the meshes only the translation is left, which is applied on the fly instead of to a copy
+    template <typename float_t>
+    myfloat staged_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, const myvec &origin,
+                          myfloat *error_estimate, std::true_type) {
+        eval::compensated_sum<myfloat> terms = asymetric_intersect(first_mesh, second_mesh, origin, eval::lines_of_second_mesh);
+        terms.add(asymetric_intersect(second_mesh, first_mesh, origin, eval::lines_of_first_mesh));
+        return volume_of(terms, error_estimate);
+    }
+
+    template <typename float_t>
+    myfloat staged_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, const myvec &origin,
+                          myfloat *error_estimate, std::false_type) {
+        return volume_of(intersection_terms(convert_precision<float_t>(first_mesh, origin), convert_precision<float_t>(second_mesh, origin)),
+                         error_estimate);
+    }
+
+    // both meshes are staged relative to their local origin, the volume does not depend on the translation
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, precision p,
+                                myfloat *error_estimate) {
+        myvec origin = local_origin(first_mesh, second_mesh);
+        switch (p) {
+            case precision::single_precision:
+                return staged_volume<float>(first_mesh, second_mesh, origin, error_estimate, std::is_same<float, myfloat>());
+#ifdef MI_FIXED_POINT_SUPPORTED
+            case precision::fixed_point: {
+                double scale = fixed_point_scale(first_mesh, second_mesh, origin);
+                fixed_mesh first(first_mesh, origin, scale), second(second_mesh, origin, scale);
+                eval::compensated_sum<double> terms = fixed_asymetric_intersect(first, second, eval::lines_of_second_mesh);
+                terms.add(fixed_asymetric_intersect(second, first, eval::lines_of_first_mesh));
+                return volume_of(terms, error_estimate);
+            }
+#else
+            // exact predicates require a 128 bit integer type
+            case precision::fixed_point:
+#endif
+            case precision::double_precision:
+                return staged_volume<double>(first_mesh, second_mesh, origin, error_estimate, std::is_same<double, myfloat>());
+            default: {
+                std::vector<basic_ntriangle<double>> first = convert_precision<double>(first_mesh, origin);
+                std::vector<basic_ntriangle<double>> second = convert_precision<double>(second_mesh, origin);
+                filter_mesh first_filter(first), second_filter(second);
+                eval::compensated_sum<double> terms = mixed_asymetric_intersect(first_filter, first, second, eval::lines_of_second_mesh);
+                terms.add(mixed_asymetric_intersect(second_filter, second, first, eval::lines_of_first_mesh));
+                return volume_of(terms, error_estimate);
+            }
+        }
+    }
+
+    // myfloat evaluation on the buffers of the workspace
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, workspace &ws) {
+        myvec origin = local_origin(first_mesh, second_mesh);
+        convert_precision(first_mesh, ws.first_local, origin);
+        convert_precision(second_mesh, ws.second_local, origin);
+
+        eval::compensated_sum<myfloat> terms = asymetric_intersect(ws.first_local, ws.second_local, eval::lines_of_second_mesh, ws.partial_sums);
+        terms.add(asymetric_intersect(ws.second_local, ws.first_local, eval::lines_of_first_mesh, ws.partial_sums));
+        return volume_of(terms, nullptr);
     }
 }
 }
@@ -11,34 +11,376 @@ extern std::vector<float> lines;
 
 namespace eval {
 
-constexpr myfloat det_epsilon = myfloat(1e-5);
+// error-free transformations (Shewchuk), a + b == sum + error and a * b == product + error hold exactly
+template <typename float_t>
+MI_SHARED
+void two_sum(float_t a, float_t b, float_t &sum, float_t &error) {
+    sum = a + b;
+    float_t b_virtual = sum - a;
+    float_t a_virtual = sum - b_virtual;
+    error = (a - a_virtual) + (b - b_virtual);
+}
+
+template <typename float_t>
+MI_SHARED
+void two_product(float_t a, float_t b, float_t &product, float_t &error) {
+    product = a * b;
+    error = std::fma(a, b, -product);
+}
+
+// exact sum of nonoverlapping components in increasing magnitude, zero components are dropped,
+// so the sign of the sum is the sign of the last component
+template <typename float_t, int capacity>
+struct expansion {
+    float_t components[capacity];
+    int size = 0;
+
+    MI_SHARED void push(float_t component) {
+        if (component != 0)
+            components[size++] = component;
+    }
+
+    MI_SHARED int sign() const {
+        return size == 0 ? 0 : components[size - 1] > 0 ? 1 : -1;
+    }
+};
+
+template <typename float_t>
+MI_SHARED
+expansion<float_t, 2> exact_difference(float_t a, float_t b) {
+    float_t sum, error;
+    two_sum(a, -b, sum, error);
+    expansion<float_t, 2> result;
+    result.push(error);
+    result.push(sum);
+    return result;
+}
+
+// e + sign * f, every component of f is added in turn, which keeps the components nonoverlapping
+template <typename float_t, int m, int n>
+MI_SHARED
+expansion<float_t, m + n> expansion_sum(const expansion<float_t, m> &e, const expansion<float_t, n> &f, float_t sign = 1) {
+    expansion<float_t, m + n> result;
+    for (int i = 0; i < e.size; ++i)
+        result.components[i] = e.components[i];
+    result.size = e.size;
+
+    for (int j = 0; j < f.size; ++j) {
+        float_t q = sign * f.components[j];
+        int size = 0;
+        for (int i = 0; i < result.size; ++i) {
+            float_t sum, error;
+            two_sum(q, result.components[i], sum, error);
+            q = sum;
+            if (error != 0)
+                result.components[size++] = error;
+        }
+        result.size = size;
+        result.push(q);
+    }
+    return result;
+}
 
-// solve linear equation for line-triangle instersection
+template <typename float_t, int m>
 MI_SHARED
-bool solve_intersection(const triangle &t, const line &l, myfloat &scalar) {
-    // solve x * (b - a) + y * (c - a) + z * (start - end) = start - a
-    mymat lineq;
-    lineq[0] = t.b - t.a;
-    lineq[1] = t.c - t.a;
-    lineq[2] = l.start - l.end;
+expansion<float_t, 2 * m> scale_expansion(const expansion<float_t, m> &e, float_t b) {
+    expansion<float_t, 2 * m> result;
+    float_t q = 0;
+    for (int i = 0; i < e.size; ++i) {
+        float_t product, product_error, sum, error;
+        two_product(e.components[i], b, product, product_error);
+        two_sum(q, product_error, sum, error);
+        result.push(error);
+        two_sum(product, sum, q, error);
+        result.push(error);
+    }
+    result.push(q);
+    return result;
+}
+
+template <typename float_t, int m, int n>
+MI_SHARED
+expansion<float_t, 2 * m * n> expansion_product(const expansion<float_t, m> &e, const expansion<float_t, n> &f) {
+    expansion<float_t, 2 * m * n> result;
+    for (int j = 0; j < f.size; ++j) {
+        expansion<float_t, 2 * m> scaled = scale_expansion(e, f.components[j]);
+        expansion<float_t, 2 * m * n + 2 * m> sum = expansion_sum(result, scaled);
+        // the partial products of e and f never exceed the capacity of the full product
+        result.size = sum.size;
+        for (int i = 0; i < sum.size; ++i)
+            result.components[i] = sum.components[i];
+    }
+    return result;
+}
+
+// component i of u x v, where u and v are exact differences of input points
+template <typename float_t>
+MI_SHARED
+expansion<float_t, 16> exact_cross(const expansion<float_t, 2> *u, const expansion<float_t, 2> *v, int i) {
+    int j = (i + 1) % 3, k = (i + 2) % 3;
+    return expansion_sum(expansion_product(u[j], v[k]), expansion_product(u[k], v[j]), float_t(-1));
+}
+
+template <typename float_t>
+MI_SHARED
+float_t l1_norm(const basic_vec<float_t> &v) {
+    return std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+}
+
+// the exact signs are computed from the input points and kept out of line, so that the filters inline
+template <typename float_t>
+MI_SHARED_SLOW_PATH
+int exact_cross_sign(const basic_vec<float_t> &u1, const basic_vec<float_t> &u0, const basic_vec<float_t> &v1, const basic_vec<float_t> &v0,
+                     int i) {
+    expansion<float_t, 2> ue[3], ve[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        ue[axis] = exact_difference(u1[axis], u0[axis]);
+        ve[axis] = exact_difference(v1[axis], v0[axis]);
+    }
+    return exact_cross(ue, ve, i).sign();
+}
+
+// sign of component i of (u1 - u0) x (v1 - v0). the rounded value decides unless it lies within its error bound
+template <typename float_t>
+MI_SHARED_KERNEL
+int cross_sign(const basic_vec<float_t> &u1, const basic_vec<float_t> &u0, const basic_vec<float_t> &v1, const basic_vec<float_t> &v0, int i) {
+    int j = (i + 1) % 3, k = (i + 2) % 3;
+    float_t left = (u1[j] - u0[j]) * (v1[k] - v0[k]);
+    float_t right = (u1[k] - u0[k]) * (v1[j] - v0[j]);
+    float_t value = left - right;
+    float_t bound = 4 * std::numeric_limits<float_t>::epsilon() * (std::abs(left) + std::abs(right));
+    if (value > bound || value < -bound)
+        return value > 0 ? 1 : -1;
+    // only a zero difference of the inputs, which is exact, yields a zero bound
+    if (bound == 0)
+        return 0;
+    return exact_cross_sign(u1, u0, v1, v0, i);
+}
+
+template <typename float_t>
+MI_SHARED_SLOW_PATH
+int exact_triple_sign(const basic_vec<float_t> &d1, const basic_vec<float_t> &d0, const basic_vec<float_t> &u1, const basic_vec<float_t> &u0,
+                      const basic_vec<float_t> &v1, const basic_vec<float_t> &v0) {
+    expansion<float_t, 2> de[3], ue[3], ve[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        de[axis] = exact_difference(d1[axis], d0[axis]);
+        ue[axis] = exact_difference(u1[axis], u0[axis]);
+        ve[axis] = exact_difference(v1[axis], v0[axis]);
+    }
+    expansion<float_t, 128> xy = expansion_sum(expansion_product(de[0], exact_cross(ue, ve, 0)),
+                                               expansion_product(de[1], exact_cross(ue, ve, 1)));
+    return expansion_sum(xy, expansion_product(de[2], exact_cross(ue, ve, 2))).sign();
+}
+
+// sign of dot(d1 - d0, (u1 - u0) x (v1 - v0)), filtered like cross_sign
+template <typename float_t>
+MI_SHARED_KERNEL
+int triple_sign(const basic_vec<float_t> &d1, const basic_vec<float_t> &d0, const basic_vec<float_t> &u1, const basic_vec<float_t> &u0,
+                const basic_vec<float_t> &v1, const basic_vec<float_t> &v0) {
+    basic_vec<float_t> d = d1 - d0, u = u1 - u0, v = v1 - v0;
+    float_t value = glm::dot(d, glm::cross(u, v));
+    float_t bound = 8 * std::numeric_limits<float_t>::epsilon() * l1_norm(d) * l1_norm(u) * l1_norm(v);
+    if (value > bound || value < -bound)
+        return value > 0 ? 1 : -1;
+    // only a zero difference of the inputs, which is exact, yields a zero bound
+    if (bound == 0)
+        return 0;
+    return exact_triple_sign(d1, d0, u1, u0, v1, v0);
+}
+
+// degenerate configurations are resolved by simulation of simplicity (see eval::perturbation), a zero value is decided
+// by the coefficients of (e, e^2, e^3) in order, which are the components of p * (u1 - u0) x (v1 - v0)
+template <typename float_t>
+MI_SHARED
+int perturbation_sign(const basic_vec<float_t> &u1, const basic_vec<float_t> &u0, const basic_vec<float_t> &v1, const basic_vec<float_t> &v0,
+                      perturbation p) {
+    for (int axis = 0; axis < 3; ++axis) {
+        int sign = cross_sign(u1, u0, v1, v0, axis);
+        if (sign != 0)
+            return p * sign;
+    }
+    return 0;
+}
+
+template <typename float_t>
+MI_SHARED
+bool lexicographic_less(const basic_vec<float_t> &a, const basic_vec<float_t> &b) {
+    return a.x < b.x || (a.x == b.x && (a.y < b.y || (a.y == b.y && a.z < b.z)));
+}
+
+// side of a point relative to the plane of a triangle, positive in the direction of (b - a) x (c - a).
+// the sign is exact, so points on the plane, shared vertices included, are resolved by the perturbation alone
+template <typename float_t>
+MI_SHARED
+int plane_side(const basic_triangle<float_t> &t, const basic_vec<float_t> &point, perturbation p) {
+    int sign = triple_sign(point, t.a, t.b, t.a, t.c, t.a);
+    return sign != 0 ? sign : perturbation_sign(t.b, t.a, t.c, t.a, p);
+}
+
+// side of the line relative to the edge (a, b)
+// the endpoints of both are ordered canonically, so the shared edge of two adjacent triangles always yields opposite
+// signs and so does a reversed line
+template <typename float_t>
+MI_SHARED
+int edge_side(const basic_line<float_t> &l, const basic_vec<float_t> &a, const basic_vec<float_t> &b, perturbation p) {
+    bool swapped = lexicographic_less(b, a);
+    const basic_vec<float_t> &lo = swapped ? b : a;
+    const basic_vec<float_t> &hi = swapped ? a : b;
+
+    bool reversed = lexicographic_less(l.end, l.start);
+    const basic_vec<float_t> &origin = reversed ? l.end : l.start;
+    const basic_vec<float_t> &target = reversed ? l.start : l.end;
+
+    // an edge sharing an endpoint with the line is coplanar with it
+    int sign = 0;
+    if (lo != l.start && lo != l.end && hi != l.start && hi != l.end)
+        sign = triple_sign(target, origin, lo, origin, hi, origin);
+    if (sign == 0)
+        sign = perturbation_sign(target, origin, hi, lo, p);
+    return swapped != reversed ? -sign : sign;
+}
+
+#ifdef MI_FIXED_POINT_SUPPORTED
+inline
+fixed_line extract_side(const fixed_triangle &t, std::size_t index) {
+    switch (index % 3) {
+        case 0:
+            return {t.a, t.b};
+        case 1:
+            return {t.b, t.c};
+        default:
+            return {t.c, t.a};
+    }
+}
+
+// glm only provides cross and dot products for floating point vectors
+inline
+fixed_vec fixed_cross(const fixed_vec &x, const fixed_vec &y) {
+    return {x.y * y.z - x.z * y.y, x.z * y.x - x.x * y.z, x.x * y.y - x.y * y.x};
+}
+
+inline
+wide_int wide_dot(const fixed_vec &x, const fixed_vec &y) {
+    return wide_int(x.x) * y.x + wide_int(x.y) * y.y + wide_int(x.z) * y.z;
+}
+
+// a zero value is decided by the coefficients of (e, e^2, e^3), like perturbation_sign
+inline
+int perturbed_sign(wide_int value, const fixed_vec &perturbation) {
+    if (value != 0)
+        return value > 0 ? 1 : -1;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (perturbation[axis] != 0)
+            return perturbation[axis] > 0 ? 1 : -1;
+    }
+    return 0;
+}
+
+// exact counterpart of the floating point edge_side, shared endpoints need no special treatment
+inline
+int edge_side(const fixed_line &l, const fixed_vec &a, const fixed_vec &b, perturbation p) {
+    bool swapped = lexicographic_less(b, a);
+    const fixed_vec &lo = swapped ? b : a;
+    const fixed_vec &hi = swapped ? a : b;
+
+    bool reversed = lexicographic_less(l.end, l.start);
+    const fixed_vec &origin = reversed ? l.end : l.start;
+    fixed_vec d = reversed ? l.start - l.end : l.end - l.start;
+
+    int sign = perturbed_sign(wide_dot(d, fixed_cross(lo - origin, hi - origin)), std::int64_t(p) * fixed_cross(d, hi - lo));
+    return swapped != reversed ? -sign : sign;
+}
+
+// all decisions are exact, only the position along the line is rounded
+inline
+crossing find_crossing(const fixed_triangle &t, const fixed_line &l, perturbation p, double &scalar) {
+    int orientation = edge_side(l, t.a, t.b, p);
+    if (orientation == 0 || edge_side(l, t.b, t.c, p) != orientation || edge_side(l, t.c, t.a, p) != orientation)
+        return crossing::none;
+
+    fixed_vec n = fixed_cross(t.b - t.a, t.c - t.a);
+    wide_int start_distance = wide_dot(n, l.start - t.a);
+    wide_int end_distance = wide_dot(n, l.end - t.a);
+
+    if (start_distance == end_distance)
+        return crossing::none;
+
+    scalar = double(start_distance) / double(start_distance - end_distance);
+
+    int start_side = perturbed_sign(start_distance, std::int64_t(p) * n);
+    if (start_side != perturbed_sign(end_distance, std::int64_t(p) * n)) {
+        scalar = glm::clamp(scalar, 0.0, 1.0);
+        return crossing::on_segment;
+    }
+
+    return (end_distance > start_distance) == (start_side > 0) ? crossing::before_segment : crossing::after_segment;
+}
+#endif
+
+// locates the crossing of a line and a triangle relative to the segment, scalar is the position along the line.
+// all decisions are exact, only the position is rounded
+template <typename float_t>
+MI_SHARED
+crossing find_crossing(const basic_triangle<float_t> &t, const basic_line<float_t> &l, perturbation p, float_t &scalar) {
+    int orientation = edge_side(l, t.a, t.b, p);
+    if (orientation == 0 || edge_side(l, t.b, t.c, p) != orientation || edge_side(l, t.c, t.a, p) != orientation)
+        return crossing::none;
 
     // line is parallel to surface
-    if (std::abs(glm::determinant(lineq)) < det_epsilon)
-        return false;
+    int direction = triple_sign(l.end, l.start, t.b, t.a, t.c, t.a);
+    if (direction == 0)
+        return crossing::none;
+
+    basic_vec<float_t> n = glm::cross(t.b - t.a, t.c - t.a);
+    float_t start_distance = glm::dot(n, l.start - t.a);
+    float_t end_distance = glm::dot(n, l.end - t.a);
+    // both endpoints may round onto the plane
+    scalar = start_distance != end_distance ? start_distance / (start_distance - end_distance) : float_t(0);
+
+    int start_side = plane_side(t, l.start, p);
+    if (start_side != plane_side(t, l.end, p)) {
+        scalar = glm::clamp(scalar, float_t(0), float_t(1));
+        return crossing::on_segment;
+    }
 
-    myvec target = l.start - t.a;
-    myvec solution = glm::inverse(lineq) * target;
+    // both endpoints lie on the same side, the line crosses behind the start if it moves away from the plane
+    return (direction > 0) == (start_side > 0) ? crossing::before_segment : crossing::after_segment;
+}
 
-    // line does not intersect triangle
-    if (solution[0] < 0 || solution[1] < 0 || solution[0] + solution[1] > 1)
-        return false;
+// bound on the error of det[x, y, z] computed from columns with the given l1 norms,
+// including the rounding of input coordinates of the given magnitude
+template <typename float_t>
+MI_SHARED
+float_t determinant_error(float_t x, float_t y, float_t z, float_t magnitude) {
+    return 16 * std::numeric_limits<float_t>::epsilon() * (x * y * z + magnitude * (x * y + y * z + x * z));
+}
 
-    scalar = solution[2];
-    return true;
+// true if two edge sides of find_crossing certainly disagree, even under a conservative bound on the rounding error,
+// branch-free so it vectorizes
+template <typename float_t>
+MI_SHARED_KERNEL
+bool certainly_misses(const basic_vec<float_t> &a, const basic_vec<float_t> &b, const basic_vec<float_t> &c,
+                      const basic_vec<float_t> &origin, const basic_vec<float_t> &d) {
+    basic_vec<float_t> ao = a - origin, bo = b - origin, co = c - origin;
+
+    float_t na = l1_norm(ao), nb = l1_norm(bo), nc = l1_norm(co), nd = l1_norm(d);
+    float_t magnitude = l1_norm(origin) + glm::max(na, glm::max(nb, nc));
+
+    float_t ab = glm::dot(d, glm::cross(ao, bo));
+    float_t bc = glm::dot(d, glm::cross(bo, co));
+    float_t ca = glm::dot(d, glm::cross(co, ao));
+    float_t eab = determinant_error(nd, na, nb, magnitude);
+    float_t ebc = determinant_error(nd, nb, nc, magnitude);
+    float_t eca = determinant_error(nd, nc, na, magnitude);
+
+    bool positive = (ab > eab) | (bc > ebc) | (ca > eca);
+    bool negative = (ab < -eab) | (bc < -ebc) | (ca < -eca);
+    return positive & negative;
 }
 
+template <typename float_t>
 MI_SHARED
-myvec face_same_direction(const myvec &reference, const myvec &target) {
+basic_vec<float_t> face_same_direction(const basic_vec<float_t> &reference, const basic_vec<float_t> &target) {
     return glm::dot(reference, target) < 0 ? -target : target;
 }
 
@@ -52,8 +394,9 @@ myvec inside_direction(const myvec &start, const myvec &end, const myvec &third_
 }
 */
 
+template <typename float_t>
 MI_SHARED
-myfloat evaluate_term(const myvec &p, const myvec &t, const myvec &u, const myvec &n) {
+float_t evaluate_term(const basic_vec<float_t> &p, const basic_vec<float_t> &t, const basic_vec<float_t> &u, const basic_vec<float_t> &n) {
 
 #if defined(MI_DEBUG) && !defined(MI_CUDA_ENABLED)
     #pragma omp critical (IO)
@@ -70,31 +413,32 @@ myfloat evaluate_term(const myvec &p, const myvec &t, const myvec &u, const myve
     return glm::dot(p, t) * glm::dot(p, u) * glm::dot(p, n);
 }
 
+template <typename float_t>
 MI_SHARED
-myfloat generate_intersection_terms(const myvec &intersection_point, const myvec &line_direction, const myvec &line_normal, const myvec &triangle_normal) {
-    myfloat sum = 0;
+float_t generate_intersection_terms(const basic_vec<float_t> &intersection_point, const basic_vec<float_t> &line_direction, const basic_vec<float_t> &line_normal, const basic_vec<float_t> &triangle_normal) {
+    float_t sum = 0;
 
-    myvec inside_direction = glm::normalize(glm::cross(line_normal, line_direction));
+    basic_vec<float_t> inside_direction = glm::normalize(glm::cross(line_normal, line_direction));
 
     // generate term tangential to line
     {
-        myvec tangent = face_same_direction(-triangle_normal, glm::normalize(line_direction));
-        myvec binormal = inside_direction;
+        basic_vec<float_t> tangent = face_same_direction(-triangle_normal, glm::normalize(line_direction));
+        basic_vec<float_t> binormal = inside_direction;
 
         sum += evaluate_term(intersection_point, tangent, binormal, line_normal);
     }
 
     // generate terms along face intersection
     {
-        myvec tangent = face_same_direction(inside_direction, glm::normalize(glm::cross(line_normal, triangle_normal)));
+        basic_vec<float_t> tangent = face_same_direction(inside_direction, glm::normalize(glm::cross(line_normal, triangle_normal)));
         // coplanar with line
         {
-            myvec binormal = face_same_direction(-triangle_normal, glm::normalize(glm::cross(line_normal, tangent)));
+            basic_vec<float_t> binormal = face_same_direction(-triangle_normal, glm::normalize(glm::cross(line_normal, tangent)));
             sum += evaluate_term(intersection_point, tangent, binormal, line_normal);
         }
         // coplanar with triangle
         {
-            myvec binormal = face_same_direction(-line_normal, glm::normalize(glm::cross(triangle_normal, tangent)));
+            basic_vec<float_t> binormal = face_same_direction(-line_normal, glm::normalize(glm::cross(triangle_normal, tangent)));
             sum += evaluate_term(intersection_point, tangent, binormal, triangle_normal);
         }
     }
@@ -102,41 +446,194 @@ myfloat generate_intersection_terms(const myvec &intersection_point, const myvec
     return sum;
 }
 
+template <typename float_t>
+MI_SHARED
+float_t generate_triple_terms(const basic_vec<float_t> &point, const basic_vec<float_t> &first_normal,
+                              const basic_vec<float_t> &second_normal, const basic_vec<float_t> &third_normal) {
+    const basic_vec<float_t> normals[3] = {first_normal, second_normal, third_normal};
+    float_t sum = 0;
+
+    // every pair of faces meets in an edge of the corner, which leaves into the half-space of the third face
+    for (int i = 0; i < 3; ++i) {
+        const basic_vec<float_t> &a = normals[i], &b = normals[(i + 1) % 3], &c = normals[(i + 2) % 3];
+        basic_vec<float_t> tangent = face_same_direction(-c, glm::normalize(glm::cross(a, b)));
+
+        // both faces along the edge, the binormal faces into the half-space of the other face
+        sum += evaluate_term(point, tangent, face_same_direction(-b, glm::normalize(glm::cross(a, tangent))), a);
+        sum += evaluate_term(point, tangent, face_same_direction(-a, glm::normalize(glm::cross(b, tangent))), b);
+    }
 
-// generate terms for intersection points
+    return sum;
+}
+
+// the area of a face is half the sum of (p.t)(p.u) over its terms, its first moment follows from the divergence theorem
+// within the face. moving the face by v changes the volume by the integral of v.n over the part inside the other mesh
+template <typename float_t>
 MI_SHARED
-myfloat intersect_line_triangle(const ntriangle &t, const triangle_side &ts, intersection_count &ic) {
-    myfloat scalar;
-    if (!solve_intersection(t, ts, scalar))
-        return 0;
+void basic_pose_gradient<float_t>::add_term(const basic_vec<float_t> &p, const basic_vec<float_t> &t, const basic_vec<float_t> &u,
+                                            const basic_vec<float_t> &n) {
+    float_t pt = glm::dot(p, t);
+    float_t ptu = pt * glm::dot(p, u);
+    area += ptu / 2 * n;
+    moment += ptu / 3 * glm::cross(p, n) - pt * ptu / 6 * glm::cross(t, n);
+}
+
+template <typename float_t>
+MI_SHARED
+void intersection_gradient(basic_pose_gradient<float_t> &gradient, const basic_vec<float_t> &intersection_point,
+                           const basic_vec<float_t> &line_direction, const basic_vec<float_t> &line_normal,
+                           const basic_vec<float_t> &triangle_normal, bool line_moves) {
+    basic_vec<float_t> inside_direction = glm::normalize(glm::cross(line_normal, line_direction));
+    basic_vec<float_t> tangent = face_same_direction(inside_direction, glm::normalize(glm::cross(line_normal, triangle_normal)));
+
+    if (line_moves) {
+        gradient.add_term(intersection_point, face_same_direction(-triangle_normal, glm::normalize(line_direction)), inside_direction, line_normal);
+        gradient.add_term(intersection_point, tangent, face_same_direction(-triangle_normal, glm::normalize(glm::cross(line_normal, tangent))),
+                          line_normal);
+    } else {
+        gradient.add_term(intersection_point, tangent, face_same_direction(-line_normal, glm::normalize(glm::cross(triangle_normal, tangent))),
+                          triangle_normal);
+    }
+}
+
+template <typename float_t>
+MI_SHARED
+void endpoint_gradient(basic_pose_gradient<float_t> &gradient, const basic_triangle_side<float_t> &ts, bool start_inside, bool end_inside) {
+    if (start_inside) {
+        basic_vec<float_t> tangent = glm::normalize(ts.end - ts.start);
+        gradient.add_term(ts.start, tangent, glm::cross(ts.n, tangent), ts.n);
+    }
+    if (end_inside) {
+        basic_vec<float_t> tangent = glm::normalize(ts.start - ts.end);
+        gradient.add_term(ts.end, tangent, -glm::cross(ts.n, tangent), ts.n);
+    }
+}
 
-    if (scalar > 1)
-        return 0;
 
-    if (scalar < 0) {
+// count intersections, returns true for intersection points on the segment
+template <typename float_t>
+MI_SHARED
+bool find_intersection(const basic_ntriangle<float_t> &t, const basic_triangle_side<float_t> &ts, perturbation p, intersection_count &ic,
+                       basic_vec<float_t> &isp) {
+    float_t scalar;
+    crossing c = find_crossing(t, ts, p, scalar);
+
+    if (c == crossing::before_segment) {
         // std::cout << "found intersection at " << scalar << ":  " <<  (1 - scalar) * start + scalar * end << std::endl;
         // std::cout << "    triangle " << triangle[0] << " " << triangle[1] << " " << triangle[2] << std::endl;
         ic.before_segment += 1;
-        return 0;
+        return false;
     }
 
+    if (c != crossing::on_segment)
+        return false;
+
     ic.on_segment += 1;
 
     // intersection point
-    myvec isp = (1 - scalar) * ts.start + scalar * ts.end;
+    isp = (1 - scalar) * ts.start + scalar * ts.end;
 
 #if defined(MI_DEBUG) && !defined(MI_CUDA_ENABLED)
     #pragma omp critical (IO)
     std::cout << "found intersection point at " << isp << std::endl;
 #endif
 
+    return true;
+}
+
+// generate terms for intersection points
+template <typename float_t>
+MI_SHARED
+float_t intersect_line_triangle(const basic_ntriangle<float_t> &t, const basic_triangle_side<float_t> &ts, perturbation p, intersection_count &ic) {
+    basic_vec<float_t> isp;
+    if (!find_intersection(t, ts, p, ic, isp))
+        return 0;
+
     return generate_intersection_terms(isp, ts.end - ts.start, ts.n, t.n);
 }
 
+template <typename float_t>
+inline
+void basic_term_batch<float_t>::push(const basic_vec<float_t> &intersection_point, const basic_vec<float_t> &line_direction, const basic_vec<float_t> &line_normal, const basic_vec<float_t> &triangle_normal) {
+    px[size] = intersection_point.x;
+    py[size] = intersection_point.y;
+    pz[size] = intersection_point.z;
+    dx[size] = line_direction.x;
+    dy[size] = line_direction.y;
+    dz[size] = line_direction.z;
+    lx[size] = line_normal.x;
+    ly[size] = line_normal.y;
+    lz[size] = line_normal.z;
+    tx[size] = triangle_normal.x;
+    ty[size] = triangle_normal.y;
+    tz[size] = triangle_normal.z;
+    size += 1;
+}
+
+// same terms as generate_intersection_terms, with the direction flips expressed as sign factors
+template <typename float_t>
+inline
+void basic_term_batch<float_t>::flush(compensated_sum<float_t> &accum) {
+#if defined(MI_DEBUG) || defined(MI_VISUALIZE)
+    // the scalar path keeps the per-term hooks of evaluate_term
+    for (std::size_t i = 0; i < size; ++i) {
+        terms[i] = generate_intersection_terms({px[i], py[i], pz[i]}, {dx[i], dy[i], dz[i]},
+                                               {lx[i], ly[i], lz[i]}, {tx[i], ty[i], tz[i]});
+    }
+#else
+    #pragma omp simd
+    for (std::size_t i = 0; i < size; ++i) {
+        // normalized line direction
+        float_t d_norm = 1 / std::sqrt(dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]);
+        float_t ux = dx[i] * d_norm, uy = dy[i] * d_norm, uz = dz[i] * d_norm;
+
+        // inside direction, perpendicular to the line within the line's face
+        float_t ix = ly[i] * uz - lz[i] * uy, iy = lz[i] * ux - lx[i] * uz, iz = lx[i] * uy - ly[i] * ux;
+        float_t i_norm = 1 / std::sqrt(ix * ix + iy * iy + iz * iz);
+        ix *= i_norm; iy *= i_norm; iz *= i_norm;
+
+        // tangent along the face intersection, facing the inside direction
+        float_t cx = ly[i] * tz[i] - lz[i] * ty[i], cy = lz[i] * tx[i] - lx[i] * tz[i], cz = lx[i] * ty[i] - ly[i] * tx[i];
+        float_t c_norm = 1 / std::sqrt(cx * cx + cy * cy + cz * cz);
+        c_norm = (cx * ix + cy * iy + cz * iz) < 0 ? -c_norm : c_norm;
+        cx *= c_norm; cy *= c_norm; cz *= c_norm;
+
+        // binormal coplanar with the line, facing against the triangle normal
+        float_t bx = ly[i] * cz - lz[i] * cy, by = lz[i] * cx - lx[i] * cz, bz = lx[i] * cy - ly[i] * cx;
+        float_t b_norm = 1 / std::sqrt(bx * bx + by * by + bz * bz);
+        b_norm = (tx[i] * bx + ty[i] * by + tz[i] * bz) > 0 ? -b_norm : b_norm;
+
+        // binormal coplanar with the triangle, facing against the line normal
+        float_t ex = ty[i] * cz - tz[i] * cy, ey = tz[i] * cx - tx[i] * cz, ez = tx[i] * cy - ty[i] * cx;
+        float_t e_norm = 1 / std::sqrt(ex * ex + ey * ey + ez * ez);
+        e_norm = (lx[i] * ex + ly[i] * ey + lz[i] * ez) > 0 ? -e_norm : e_norm;
+
+        // tangent along the line, facing against the triangle normal
+        float_t u_sign = (tx[i] * ux + ty[i] * uy + tz[i] * uz) > 0 ? -1 : 1;
+
+        float_t p_u = px[i] * ux + py[i] * uy + pz[i] * uz;
+        float_t p_i = px[i] * ix + py[i] * iy + pz[i] * iz;
+        float_t p_c = px[i] * cx + py[i] * cy + pz[i] * cz;
+        float_t p_b = (px[i] * bx + py[i] * by + pz[i] * bz) * b_norm;
+        float_t p_e = (px[i] * ex + py[i] * ey + pz[i] * ez) * e_norm;
+        float_t p_l = px[i] * lx[i] + py[i] * ly[i] + pz[i] * lz[i];
+        float_t p_t = px[i] * tx[i] + py[i] * ty[i] + pz[i] * tz[i];
+
+        terms[i] = u_sign * p_u * p_i * p_l + p_c * p_b * p_l + p_c * p_e * p_t;
+    }
+#endif
+
+    for (std::size_t i = 0; i < size; ++i)
+        accum.add(terms[i]);
+
+    size = 0;
+}
+
 // generate terms for points inside the other volume
+template <typename float_t>
 MI_SHARED
-myfloat evaluate_line_intersection(const triangle_side &ts, bool start_inside, bool end_inside) {
-    myfloat accum = 0;
+float_t evaluate_line_intersection(const basic_triangle_side<float_t> &ts, bool start_inside, bool end_inside) {
+    float_t accum = 0;
 
     // std::cout << "found " << ic.on_segment << " intersections on segment and " << ic.before_segment << " before." << std::endl;
 
@@ -146,8 +643,8 @@ myfloat evaluate_line_intersection(const triangle_side &ts, bool start_inside, b
         #pragma omp critical (IO)
         std::cout << "start point " << start << " is inside the other polyhedron" << std::endl;
 #endif
-        myvec tangent = glm::normalize(ts.end - ts.start);
-        myvec binormal = glm::cross(ts.n, tangent);
+        basic_vec<float_t> tangent = glm::normalize(ts.end - ts.start);
+        basic_vec<float_t> binormal = glm::cross(ts.n, tangent);
 
         accum += evaluate_term(ts.start, tangent, binormal, ts.n);
     }
@@ -158,8 +655,8 @@ myfloat evaluate_line_intersection(const triangle_side &ts, bool start_inside, b
         #pragma omp critical (IO)
         std::cout << "end point " << end << " is inside the other polyhedron" << std::endl;
 #endif
-        myvec tangent = glm::normalize(ts.start - ts.end);
-        myvec binormal = - glm::cross(ts.n, tangent);
+        basic_vec<float_t> tangent = glm::normalize(ts.start - ts.end);
+        basic_vec<float_t> binormal = - glm::cross(ts.n, tangent);
 
         accum += evaluate_term(ts.end, tangent, binormal, ts.n);
     }
@@ -167,18 +664,31 @@ myfloat evaluate_line_intersection(const triangle_side &ts, bool start_inside, b
     return accum;
 }
 
+template <typename float_t>
 MI_SHARED
-myfloat evaluate_line_intersection(const triangle_side &ts, const intersection_count &ic) {
+float_t evaluate_line_intersection(const basic_triangle_side<float_t> &ts, const intersection_count &ic) {
     return evaluate_line_intersection(ts, ic.before_segment % 2 == 1, (ic.before_segment + ic.on_segment) % 2 == 1);
 }
 
 MI_SHARED
-myfloat local_intersect_line_triangle(const ntriangle &t, const triangle_side &ts, localized_intersection_count &lic) {
-    myfloat scalar;
-    if (!solve_intersection(t, ts, scalar))
-        return 0;
+myfloat crossing_error(const ntriangle &t, const line &l) {
+    myvec u = t.b - t.a, v = t.c - t.a;
+    myfloat start_distance = glm::dot(glm::cross(u, v), l.start - t.a);
+    myfloat end_distance = glm::dot(glm::cross(u, v), l.end - t.a);
+    myfloat bound = 8 * std::numeric_limits<myfloat>::epsilon() * l1_norm(u) * l1_norm(v)
+                    * (l1_norm(l.start - t.a) + l1_norm(l.end - t.a));
+    myfloat denominator = std::abs(start_distance - end_distance) - bound;
+    return denominator > 0 ? bound / denominator + std::numeric_limits<myfloat>::epsilon()
+                           : std::numeric_limits<myfloat>::infinity();
+}
 
-    if (scalar > 1 || scalar < 0)
+MI_SHARED
+myfloat local_intersect_line_triangle(const ntriangle &t, const triangle_side &ts, perturbation p, localized_intersection_count &lic) {
+    myfloat scalar;
+    crossing c = find_crossing(t, ts, p, scalar);
+    if (c == crossing::before_segment)
+        lic.before_segment += 1;
+    if (c != crossing::on_segment)
         return 0;
 
     // intersection point
@@ -189,17 +699,12 @@ myfloat local_intersect_line_triangle(const ntriangle &t, const triangle_side &t
     std::cout << "found intersection point at " << isp << std::endl;
 #endif
 
+    myfloat error = crossing_error(t, ts);
+    // the line leaves the other mesh if it runs along the outward normal
+    int leaving = triple_sign(ts.end, ts.start, t.b, t.a, t.c, t.a) > 0;
     lic.on_segment += 1;
-    if (scalar < lic.closest_point) {
-        lic.closest_point = scalar;
-        lic.is_start_inside = glm::dot(ts.start - isp, t.n) < 0;
-
-#if defined(MI_DEBUG) && !defined(MI_CUDA_ENABLED)
-        #pragma omp critical (IO)
-        std::cout << "  intersection minimizes scalar to " << scalar << std::endl;
-        std::cout << "  is start point inside: " << lic.is_start_inside << std::endl;
-#endif
-    }
+    lic.first_lower[leaving] = glm::min(lic.first_lower[leaving], scalar - error);
+    lic.first_upper[leaving] = glm::min(lic.first_upper[leaving], scalar + error);
 
     return generate_intersection_terms(isp, ts.end - ts.start, ts.n, t.n);
 }
@@ -1,15 +1,21 @@
 #include "../evaluation.h"
+#include "../intersect.h"
+#include "../mesh.h"
 
 #include "../glm/glm.hpp"
 
 #include <algorithm>
+#include <limits>
 #include <vector>
 
 #include <thrust/device_vector.h>
 #include <thrust/fill.h>
+#include <thrust/transform.h>
 
 namespace mesh {
 namespace impl {
+// kept apart from the host engine, both are compiled into the same translation unit
+namespace device {
 
     // atomicAdd wrapper
     template <typename value_t>
@@ -37,6 +43,15 @@ namespace impl {
 
     using ic = eval::intersection_count;
 
+    struct translate_to_origin {
+        myvec origin;
+
+        MI_SHARED
+        ntriangle operator()(const ntriangle &t) const {
+            return relative_to(t, origin);
+        }
+    };
+
     __device__ __forceinline__
     void fuse_count(ic &global, const ic &local) {
         if (local.on_segment != 0)
@@ -52,7 +67,8 @@ namespace impl {
     }
 
     __global__
-    void intersect_kernel(const ntriangle *line_buffer, std::size_t line_count, const ntriangle *triangle_buffer, std::size_t triange_count, myfloat *accum, ic *ic) {
+    void intersect_kernel(const ntriangle *line_buffer, std::size_t line_count, const ntriangle *triangle_buffer, std::size_t triange_count,
+                          eval::perturbation p, double *accum, ic *ic) {
 
         std::size_t line_id = blockIdx.x * blockDim.x + threadIdx.x;
         std::size_t triangle_id = blockIdx.y * blockDim.y + threadIdx.y;
@@ -68,18 +84,18 @@ namespace impl {
 
             eval::intersection_count local_ic = eval::intersection_count::zero();
 
-            myfloat result = eval::intersect_line_triangle(triangle_buffer[triangle_index], side, local_ic);
+            myfloat result = eval::intersect_line_triangle(triangle_buffer[triangle_index], side, p, local_ic);
 
             fuse_count(ic[line_id], local_ic);
 
             if (result != 0)
-                cuda_atomic_add(accum, result);
+                cuda_atomic_add(accum, (double) result);
         }
     }
 
     __global__
 #ifdef MI_SPARSE_EVAL
-    void evaluate_kernel(const ntriangle *line_buffer, std::size_t line_count, myfloat *accum, const ic *ic) {
+    void evaluate_kernel(const ntriangle *line_buffer, std::size_t line_count, double *accum, const ic *ic) {
 #else
     void evaluate_kernel(const ntriangle *line_buffer, std::size_t line_count, myfloat *point_eval_buffer, const ic *ic) {
 #endif
@@ -108,7 +124,7 @@ namespace impl {
 #ifdef MI_SPARSE_EVAL
         // sparse reduction
         if (lane_id == 0 && result != 0)
-            cuda_atomic_add(accum, result);
+            cuda_atomic_add(accum, (double) result);
 #else
         // dense reduction setup
         if (lane_id == 0)
@@ -121,7 +137,8 @@ namespace impl {
             std::size_t line_count,
             const ntriangle *triangle_buffer,
             std::size_t triange_count,
-            myfloat *accum,
+            eval::perturbation p,
+            double *accum,
             myfloat *point_eval_buffer,
             ic *ic) {
 
@@ -133,7 +150,7 @@ namespace impl {
                     (unsigned) safe_division(line_count, threads.x),
                     (unsigned) std::min(thread_limit_y, safe_division(triange_count, threads.y))
             );
-            intersect_kernel<<<blocks, threads>>>(line_buffer, line_count, triangle_buffer, triange_count, accum, ic);
+            intersect_kernel<<<blocks, threads>>>(line_buffer, line_count, triangle_buffer, triange_count, p, accum, ic);
         }
 
         {
@@ -149,17 +166,21 @@ namespace impl {
 
     myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh) {
 
-        myfloat accum = 0;
+        // the terms are accumulated in double, which bounds the cancellation error of single precision builds
+        double accum = 0;
 
         std::size_t first_mesh_triangles = first_mesh.size();
         std::size_t second_mesh_triangles = second_mesh.size();
 
         std::size_t triangles_max = std::max(first_mesh_triangles, second_mesh_triangles);
 
-        // memory setup
+        // memory setup, the meshes are moved to the local origin in place on the device
         thrust::device_vector<ntriangle> first_mesh_d(first_mesh);
         thrust::device_vector<ntriangle> second_mesh_d(second_mesh);
-        thrust::device_vector<myfloat> accum_d(1, 0);
+        translate_to_origin translate {local_origin(first_mesh, second_mesh)};
+        thrust::transform(first_mesh_d.begin(), first_mesh_d.end(), first_mesh_d.begin(), translate);
+        thrust::transform(second_mesh_d.begin(), second_mesh_d.end(), second_mesh_d.begin(), translate);
+        thrust::device_vector<double> accum_d(1, 0);
 #ifdef MI_SPARSE_EVAL
         thrust::device_vector<myfloat> point_eval_d;
 #else
@@ -169,6 +190,7 @@ namespace impl {
 
         asymetric_intersect(first_mesh_d.data().get(), first_mesh_triangles * 3,
                             second_mesh_d.data().get(), second_mesh_triangles,
+                            eval::lines_of_first_mesh,
                             accum_d.data().get(),
                             point_eval_d.data().get(),
                             intersections_d.data().get());
@@ -176,7 +198,7 @@ namespace impl {
 #ifndef MI_SPARSE_EVAL
         // reduce point evaluation results
         std::size_t first_len = safe_division(first_mesh_triangles * 3, 32);
-        accum += thrust::reduce(point_eval_d.data(), point_eval_d.data() + first_len);
+        accum += thrust::reduce(point_eval_d.data(), point_eval_d.data() + first_len, 0.0);
 #endif
 
         // reset intersection count
@@ -185,17 +207,27 @@ namespace impl {
         // do the same with both meshes swapped
         asymetric_intersect(second_mesh_d.data().get(), second_mesh_triangles * 3,
                             first_mesh_d.data().get(), first_mesh_triangles,
+                            eval::lines_of_second_mesh,
                             accum_d.data().get(),
                             point_eval_d.data().get(),
                             intersections_d.data().get());
 
 #ifndef MI_SPARSE_EVAL
         std::size_t second_len = safe_division(second_mesh_triangles * 3, 32);
-        accum += thrust::reduce(point_eval_d.data(), point_eval_d.data() + second_len);
+        accum += thrust::reduce(point_eval_d.data(), point_eval_d.data() + second_len, 0.0);
 #endif
 
         // implicit memory transfer
-        return (accum + accum_d[0]) / 6;
+        return (myfloat) ((accum + accum_d[0]) / 6);
     }
+
+    // the device kernels are only compiled for myfloat and do not track the magnitude of the terms
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, precision,
+                                myfloat *error_estimate) {
+        if (error_estimate)
+            *error_estimate = std::numeric_limits<myfloat>::quiet_NaN();
+        return intersection_volume(first_mesh, second_mesh);
+    }
+}
 }
 }
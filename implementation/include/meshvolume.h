@@ -0,0 +1,81 @@
+#ifndef MESHVOLUME_H
+#define MESHVOLUME_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* meshes are owned by the library and only handed out as opaque handles */
+typedef struct mv_mesh mv_mesh;
+typedef struct mv_prepared_mesh mv_prepared_mesh;
+
+typedef enum mv_status {
+    MV_OK = 0,
+    MV_INVALID_ARGUMENT,
+    MV_IO_ERROR,
+    /* the requested engine is not compiled into this library, or does not evaluate in the requested precision */
+    MV_UNAVAILABLE,
+    MV_INTERNAL_ERROR
+} mv_status;
+
+typedef enum mv_engine {
+    MV_ENGINE_AUTO = 0,
+    MV_ENGINE_BRUTE_FORCE,
+    MV_ENGINE_PIPELINED,
+    MV_ENGINE_LOCALIZED,
+    MV_ENGINE_ACCELERATED,
+    MV_ENGINE_CONVEX
+} mv_engine;
+
+typedef enum mv_precision {
+    MV_PRECISION_DEFAULT = 0,
+    MV_PRECISION_SINGLE,
+    MV_PRECISION_DOUBLE,
+    MV_PRECISION_MIXED,
+    MV_PRECISION_FIXED
+} mv_precision;
+
+/* zero initialization selects the defaults, threads = 0 keeps the openmp default */
+typedef struct mv_options {
+    mv_engine engine;
+    mv_precision precision;
+    int threads;
+} mv_options;
+
+/* message of the last failed call on the calling thread, valid until the next call */
+const char *mv_last_error(void);
+
+/* loads an stl file */
+mv_status mv_load(const char *path, mv_mesh **mesh);
+/* copies triangle_count triangles of three xyz vertices each */
+mv_status mv_create(const double *vertices, size_t triangle_count, mv_mesh **mesh);
+void mv_free(mv_mesh *mesh);
+
+size_t mv_triangle_count(const mv_mesh *mesh);
+mv_status mv_volume(const mv_mesh *mesh, double *volume);
+
+/* a prepared mesh does not depend on the mesh it was prepared from, which may be freed */
+mv_status mv_prepare(const mv_mesh *mesh, mv_prepared_mesh **prepared);
+void mv_free_prepared(mv_prepared_mesh *prepared);
+
+/* options and error_estimate may be NULL, prepared meshes may be shared by concurrent calls */
+mv_status mv_intersection_volume(const mv_prepared_mesh *first, const mv_prepared_mesh *second, const mv_options *options,
+                                 double *volume, double *error_estimate);
+
+/* common volume of count meshes in a single pass, error_estimate may be NULL */
+mv_status mv_intersection_volume_many(const mv_prepared_mesh *const *meshes, size_t count, double *volume, double *error_estimate);
+
+/* volume covered by any of count meshes in a single pass, error_estimate may be NULL */
+mv_status mv_union_volume(const mv_prepared_mesh *const *meshes, size_t count, double *volume, double *error_estimate);
+
+/* the second mesh placed at a rigid pose of 16 row-major values, neither mesh is prepared again */
+mv_status mv_intersection_volume_posed(const mv_prepared_mesh *first, const mv_prepared_mesh *second, const double *second_pose,
+                                       const mv_options *options, double *volume, double *error_estimate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,209 @@
+
+#include "incremental.h"
+#include "mesh.h"
+#include "reduction.h"
+
+#include <stdexcept>
+
+namespace mesh {
+
+    ntriangle posed_triangle(const mymat &rotation, const myvec &translation, const ntriangle &t) {
+        return ntriangle(rotation * t.a + translation, rotation * t.b + translation, rotation * t.c + translation, rotation * t.n);
+    }
+
+    // full evaluation of a side against the candidate triangles of the other mesh, in the staged frame
+    // terms on faces of the second mesh also go into the gradient
+    template <typename triangle_at_t>
+    myfloat evaluate_side(const triangle_side &side, bool start_inside, const std::vector<std::size_t> &candidates,
+                          triangle_at_t &&triangle_at, eval::perturbation p, unsigned char &inside, eval::pose_gradient &gradient) {
+        const bool side_moves = p == eval::lines_of_second_mesh;
+        eval::term_batch batch;
+        eval::compensated_sum<myfloat> accum;
+        bool end_inside = start_inside;
+
+        for (std::size_t candidate : candidates) {
+            const ntriangle t = triangle_at(candidate);
+            myfloat scalar;
+            if (eval::find_crossing(t, side, p, scalar) != eval::crossing::on_segment)
+                continue;
+
+            end_inside = !end_inside;
+            if (batch.full())
+                batch.flush(accum);
+            myvec intersection_point = (1 - scalar) * side.start + scalar * side.end;
+            batch.push(intersection_point, side.end - side.start, side.n, t.n);
+            eval::intersection_gradient(gradient, intersection_point, side.end - side.start, side.n, t.n, side_moves);
+        }
+
+        batch.flush(accum);
+        accum.add(eval::evaluate_line_intersection(side, start_inside, end_inside));
+        if (side_moves)
+            eval::endpoint_gradient(gradient, side, start_inside, end_inside);
+        inside = (unsigned char) (start_inside | end_inside << 1);
+        return accum.value();
+    }
+
+    mymat4 staged_pose(const myvec &origin, const mymat4 &pose) {
+        if (!is_rigid(pose))
+            throw std::invalid_argument("The pose is not a rigid transformation.");
+
+        mymat4 shift(1);
+        shift[3] = myvec4(-origin, 1);
+        return shift * pose;
+    }
+
+    // the first mesh does not move, so the origin is the snapped centre of its own bounding box
+    incremental_query::incremental_query(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh, const mymat4 &second_pose)
+            : origin(local_origin(first_mesh.triangles, first_mesh.triangles)),
+              first(convert_precision<myfloat>(first_mesh.triangles, origin)), second(second_mesh.triangles),
+              first_grid(first), second_grid(second),
+              first_classifier(first, eval::lines_of_second_mesh), second_classifier(second, eval::lines_of_first_mesh),
+              pose(staged_pose(origin, second_pose)) {
+        first_contributions.assign(first.size() * 3, 0);
+        second_inside.assign(second.size() * 3, 0);
+
+        mymat4 inverse = inverse_rigid(pose);
+        update_first_sides(inverse, inverse, true);
+        update_second_sides(pose, true);
+    }
+
+    myfloat incremental_query::move(const mymat4 &second_pose) {
+        mymat4 previous = pose;
+        pose = staged_pose(origin, second_pose);
+
+        retested = 0;
+        update_first_sides(inverse_rigid(previous), inverse_rigid(pose), false);
+        update_second_sides(previous, false);
+        return volume();
+    }
+
+    // the first mesh is swept through the frame of the second mesh, where the grid and the classifier of the
+    // second mesh were built once. the crossings themselves are tested in the staged frame, like the other sides
+    void incremental_query::update_first_sides(const mymat4 &previous_inverse, const mymat4 &inverse, bool initial) {
+        const mymat previous_rotation(previous_inverse), local_rotation(inverse), rotation(pose);
+        const myvec previous_translation(previous_inverse[3]), local_translation(inverse[3]), translation(pose[3]);
+        auto posed_second = [&](std::size_t triangle) { return posed_triangle(rotation, translation, second[triangle]); };
+        std::vector<eval::pose_gradient> gradients((first.size() + reduction_block_size - 1) / reduction_block_size);
+
+        first_terms.add(deterministic_reduce<myfloat>(first.size(), [&](std::size_t first_triangle, std::size_t last_triangle) {
+            eval::compensated_sum<myfloat> difference;
+            eval::pose_gradient &gradient = gradients[first_triangle / reduction_block_size];
+            std::vector<std::size_t> candidates;
+            std::size_t block_retested = 0;
+
+            for (std::size_t i = first_triangle; i < last_triangle; ++i) {
+                ntriangle local = posed_triangle(local_rotation, local_translation, first[i]);
+                myvec min = triangle_min(local), max = triangle_max(local);
+                if (!initial) {
+                    ntriangle previous = posed_triangle(previous_rotation, previous_translation, first[i]);
+                    min = glm::min(min, triangle_min(previous));
+                    max = glm::max(max, triangle_max(previous));
+                }
+
+                candidates.clear();
+                second_grid.query(min, max, [&](std::size_t triangle) { candidates.push_back(triangle); });
+                // no triangle of the second mesh came close, so neither the crossings nor the inside state changed
+                if (candidates.empty() && !initial)
+                    continue;
+
+                for (std::size_t k = 0; k < 3; ++k) {
+                    triangle_side side = extract_side(first[i], k);
+                    bool start_inside = second_classifier.is_inside(local_rotation * side.start + local_translation);
+                    unsigned char inside;
+                    myfloat contribution = evaluate_side(side, start_inside, candidates, posed_second, eval::lines_of_first_mesh, inside,
+                                                         gradient);
+
+                    difference.add(contribution);
+                    difference.add(-first_contributions[3 * i + k]);
+                    first_contributions[3 * i + k] = contribution;
+                }
+                block_retested += 3;
+            }
+
+            #pragma omp atomic
+            retested += block_retested;
+
+            return difference;
+        }));
+
+        first_gradient = eval::pose_gradient();
+        for (const auto &gradient : gradients)
+            first_gradient.add(gradient);
+    }
+
+    // every side of the second mesh moves, but only those whose swept box reaches the first mesh are tested again,
+    // the others keep their inside state and only their endpoint terms are evaluated at the new pose
+    void incremental_query::update_second_sides(const mymat4 &previous, bool initial) {
+        const mymat previous_rotation(previous), rotation(pose);
+        const myvec previous_translation(previous[3]), translation(pose[3]);
+        auto first_at = [&](std::size_t triangle) { return first[triangle]; };
+        std::vector<eval::pose_gradient> gradients((second.size() + reduction_block_size - 1) / reduction_block_size);
+
+        second_terms = deterministic_reduce<myfloat>(second.size(), [&](std::size_t first_triangle, std::size_t last_triangle) {
+            eval::compensated_sum<myfloat> accum;
+            eval::pose_gradient &gradient = gradients[first_triangle / reduction_block_size];
+            std::vector<std::size_t> candidates;
+            std::size_t block_retested = 0;
+
+            for (std::size_t i = first_triangle; i < last_triangle; ++i) {
+                ntriangle posed = posed_triangle(rotation, translation, second[i]);
+                myvec min = triangle_min(posed), max = triangle_max(posed);
+                if (!initial) {
+                    ntriangle before = posed_triangle(previous_rotation, previous_translation, second[i]);
+                    min = glm::min(min, triangle_min(before));
+                    max = glm::max(max, triangle_max(before));
+                }
+
+                candidates.clear();
+                first_grid.query(min, max, [&](std::size_t triangle) { candidates.push_back(triangle); });
+
+                if (candidates.empty() && !initial) {
+                    for (std::size_t k = 0; k < 3; ++k) {
+                        unsigned char inside = second_inside[3 * i + k];
+                        if (!inside)
+                            continue;
+                        triangle_side side = extract_side(posed, k);
+                        accum.add(eval::evaluate_line_intersection(side, (inside & 1) != 0, (inside & 2) != 0));
+                        eval::endpoint_gradient(gradient, side, (inside & 1) != 0, (inside & 2) != 0);
+                    }
+                    continue;
+                }
+
+                for (std::size_t k = 0; k < 3; ++k) {
+                    triangle_side side = extract_side(posed, k);
+                    bool start_inside = first_classifier.is_inside(side.start);
+                    accum.add(evaluate_side(side, start_inside, candidates, first_at, eval::lines_of_second_mesh, second_inside[3 * i + k],
+                                            gradient));
+                }
+                block_retested += 3;
+            }
+
+            #pragma omp atomic
+            retested += block_retested;
+
+            return accum;
+        });
+
+        second_gradient = eval::pose_gradient();
+        for (const auto &gradient : gradients)
+            second_gradient.add(gradient);
+    }
+
+    // the gradient was collected in the staged frame, which is the frame of the first mesh shifted by origin
+    volume_gradient incremental_query::gradient(const myvec &centre) const {
+        eval::pose_gradient sum = first_gradient;
+        sum.add(second_gradient);
+
+        volume_gradient result;
+        result.translation = sum.area;
+        result.rotation = sum.moment - glm::cross(centre - origin, sum.area);
+        return result;
+    }
+
+    myfloat intersection_volume_gradient(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh, const mymat4 &second_pose,
+                                         const myvec &centre, volume_gradient &gradient) {
+        incremental_query query(first_mesh, second_mesh, second_pose);
+        gradient = query.gradient(centre);
+        return query.volume();
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef MI_INCREMENTAL_H
+#define MI_INCREMENTAL_H
+
+#include "classify.h"
+#include "engine.h"
+#include "evaluation.h"
+#include "globals.h"
+#include "grid.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace mesh {
+
+    // derivative of the volume with respect to translating the second mesh, and to rotating it about a centre
+    // with an angular velocity along each axis, in the frame of the first mesh
+    struct volume_gradient {
+        myvec translation = myvec(0);
+        myvec rotation = myvec(0);
+    };
+
+    // volume of two meshes while the second one moves in small rigid steps. the contribution of every side of the
+    // first mesh and the inside state of every side of the second mesh are kept between steps. a step retests
+    // only the sides whose bounding box, swept from the previous to the new pose, reaches a triangle of the other
+    // mesh. the other sides keep their state, the sides of the second mesh are only moved along
+    class incremental_query {
+    public:
+        // evaluates the initial pose in full, throws std::invalid_argument if it is not rigid
+        incremental_query(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh, const mymat4 &second_pose = mymat4(1));
+
+        incremental_query(const incremental_query &) = delete;
+        incremental_query &operator=(const incremental_query &) = delete;
+
+        // throws std::invalid_argument if the pose is not rigid
+        myfloat move(const mymat4 &second_pose);
+
+        myfloat volume() const { return (first_terms.value() + second_terms.value()) / 6; }
+        // sides of both meshes tested against the other mesh by the last step
+        std::size_t retested_sides() const { return retested; }
+        // collected from the terms of the last step on the faces of the second mesh, without further traversal
+        volume_gradient gradient(const myvec &centre) const;
+
+    private:
+        void update_first_sides(const mymat4 &previous_inverse, const mymat4 &inverse, bool initial);
+        void update_second_sides(const mymat4 &previous, bool initial);
+
+        // the first mesh is staged relative to origin once, the second mesh stays in its own frame
+        myvec origin;
+        std::vector<ntriangle> first;
+        std::vector<ntriangle> second;
+        triangle_grid first_grid, second_grid;
+        // the classifiers refer to the meshes above
+        projected_classifier first_classifier, second_classifier;
+
+        // maps the frame of the second mesh into the staged frame
+        mymat4 pose;
+
+        // per side of the first mesh, their sum is updated by the differences of the retested sides
+        std::vector<myfloat> first_contributions;
+        eval::compensated_sum<myfloat> first_terms;
+        // per side of the second mesh, bit 0 for the start and bit 1 for the end inside the first mesh
+        std::vector<unsigned char> second_inside;
+        eval::compensated_sum<myfloat> second_terms;
+        // only sides which cross the other mesh or lie inside it contribute, so every step collects the gradient anew
+        eval::pose_gradient first_gradient, second_gradient;
+
+        std::size_t retested = 0;
+    };
+
+    // volume and gradient of the second mesh at a rigid pose in a single traversal, throws std::invalid_argument
+    // if the pose is not rigid
+    myfloat intersection_volume_gradient(const prepared_mesh &first_mesh, const prepared_mesh &second_mesh, const mymat4 &second_pose,
+                                         const myvec &centre, volume_gradient &gradient);
+}
+
+#endif
@@ -2,12 +2,12 @@
 #include "globals.h"
 #include "mesh.h"
 
+#include <stdexcept>
 #include <vector>
 
+#include "impl/cpu.inl"
 #ifdef MI_CUDA_ENABLED
 #   include "impl/gpu.inl"
-#else
-#   include "impl/cpu.inl"
 #endif
 
 namespace mesh {
@@ -16,10 +16,56 @@ namespace mesh {
         // this could be computed on the gpu
         std::vector<ntriangle> first_mesh_normals = mesh::generate_normals(first_mesh);
         std::vector<ntriangle> second_mesh_normals = mesh::generate_normals(second_mesh);
-        return impl::intersection_volume(first_mesh_normals, second_mesh_normals);
+        return intersection_volume(first_mesh_normals, second_mesh_normals, default_precision, nullptr);
     }
 
     myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh) {
-        return impl::intersection_volume(first_mesh, second_mesh);
+        return intersection_volume(first_mesh, second_mesh, default_precision, nullptr);
+    }
+
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, precision p,
+                                myfloat *error_estimate) {
+#ifdef MI_CUDA_ENABLED
+        return impl::device::intersection_volume(first_mesh, second_mesh, p, error_estimate);
+#else
+        return impl::intersection_volume(first_mesh, second_mesh, p, error_estimate);
+#endif
+    }
+
+    myfloat intersection_volume(const std::vector<triangle> &first_mesh, const std::vector<triangle> &second_mesh, workspace &ws) {
+        ws.first_mesh.clear();
+        ws.second_mesh.clear();
+        mesh::generate_normals(ws.first_mesh, first_mesh);
+        mesh::generate_normals(ws.second_mesh, second_mesh);
+        return impl::intersection_volume(ws.first_mesh, ws.second_mesh, ws);
+    }
+
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, workspace &ws) {
+        return impl::intersection_volume(first_mesh, second_mesh, ws);
+    }
+
+    myfloat host_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, precision p,
+                                     myfloat *error_estimate) {
+        return impl::intersection_volume(first_mesh, second_mesh, p, error_estimate);
+    }
+
+    bool device_available() {
+#ifdef MI_CUDA_ENABLED
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    myfloat device_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                       myfloat *error_estimate) {
+#ifdef MI_CUDA_ENABLED
+        return impl::device::intersection_volume(first_mesh, second_mesh, default_precision, error_estimate);
+#else
+        (void) first_mesh;
+        (void) second_mesh;
+        (void) error_estimate;
+        throw std::runtime_error("Device code is not compiled in.");
+#endif
     }
 }
@@ -6,8 +6,43 @@
 #include <vector>
 
 namespace mesh {
+    struct workspace;
+
+    enum class precision {
+        single_precision,
+        double_precision,
+        // float kernels with a conservative error bound, uncertain decisions and all terms are computed in double
+        mixed_precision,
+        // vertices are snapped to the finest 2^-k grid around the local origin that fits into eval::fixed_point_bits,
+        // all decisions are exact integer predicates and only the terms are computed in double
+        fixed_point
+    };
+
+#ifdef MI_SINGLE_PRECISION
+    constexpr precision default_precision = precision::single_precision;
+#else
+    constexpr precision default_precision = precision::double_precision;
+#endif
+
+    // brute force, on the device in CUDA builds and on the host otherwise
     myfloat intersection_volume(const std::vector<triangle> &first_mesh, const std::vector<triangle> &second_mesh);
     myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh);
+    // error_estimate receives a first order estimate of the rounding error of the volume
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, precision p,
+                                myfloat *error_estimate = nullptr);
+
+    // brute force on the host in myfloat precision, repeated queries on the same workspace do not allocate
+    myfloat intersection_volume(const std::vector<triangle> &first_mesh, const std::vector<triangle> &second_mesh, workspace &ws);
+    myfloat intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, workspace &ws);
+
+    // brute force on the host regardless of the build
+    myfloat host_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh, precision p,
+                                     myfloat *error_estimate = nullptr);
+
+    // brute force on the device, throws std::runtime_error unless the device code is compiled in
+    bool device_available();
+    myfloat device_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                       myfloat *error_estimate = nullptr);
 }
 
 #endif
@@ -1,8 +1,13 @@
 
+#include "batch.h"
+#include "breakdown.h"
+#include "engine.h"
 #include "globals.h"
+#include "incremental.h"
 #include "intersect.h"
-#include "localized.h"
 #include "mesh.h"
+#include "multi.h"
+#include "server.h"
 
 #ifdef MI_VISUALIZE
 #include "visualize.h"
@@ -12,36 +17,15 @@
 #include "glm/gtx/transform.hpp"
 #undef GLM_ENABLE_EXPERIMENTAL
 
-#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <iomanip>
-#include <numeric>
-
-#ifdef MI_TIMED
-#include <chrono>
-#endif
-
-void center_pair_around_origin(std::vector<triangle> &fst, std::vector<triangle> &snd) {
-
-    auto reduce = [](const myvec &acc, const triangle &t){
-        return acc + t.a + t.b + t.c;
-    };
-
-    myvec sum = std::accumulate(fst.begin(), fst.end(), myvec(), reduce)
-            + std::accumulate(snd.begin(), snd.end(), myvec(), reduce);
-
-    std::size_t count = fst.size() + snd.size();
-    myvec avg = sum / static_cast<myfloat>(count);
-
-    auto shift = [&](triangle &t){
-        t.a -= avg;
-        t.b -= avg;
-        t.c -= avg;
-    };
-
-    std::for_each(fst.begin(), fst.end(), shift);
-    std::for_each(snd.begin(), snd.end(), shift);
-}
+#include <stdexcept>
+#include <string>
 
 // test data
 
@@ -64,6 +48,13 @@ void center_pair_around_origin(std::vector<triangle> &fst, std::vector<triangle>
 std::vector<float> lines;
 #endif
 
+void print_engines(std::ostream &out) {
+    out << "auto";
+    for (const auto &info : mesh::registered_engines())
+        if (info.available)
+            out << ", " << info.name;
+}
+
 int main(int argc, char **argv) {
 
     std::cout << std::setprecision(std::numeric_limits<myfloat>::digits10 + 1);
@@ -72,45 +63,365 @@ int main(int argc, char **argv) {
     std::vector<triangle> second_mesh;
 
     // command line interface
-    if (argc <= 1 || argc >= 4) {
+    mesh::options options;
+    std::vector<std::string> paths;
+    bool serve = false;
+    std::string socket_path;
+    long cache_megabytes = 1024;
+    std::string batch_path;
+    std::string against_path;
+    std::string all_pairs_path;
+    std::string union_path;
+    std::string breakdown;
+    bool gradient = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--precision") {
+            if (i + 1 >= argc || !mesh::parse_precision(argv[++i], options.precision)) {
+                std::cerr << "Expected single, double, mixed or fixed after --precision.";
+                return 1;
+            }
+        } else if (arg == "--engine") {
+            if (i + 1 >= argc || !mesh::parse_engine(argv[++i], options.engine)) {
+                std::cerr << "Expected one of ";
+                print_engines(std::cerr);
+                std::cerr << " after --engine.";
+                return 1;
+            }
+        } else if (arg == "--threads") {
+            if (i + 1 >= argc || (options.threads = std::atoi(argv[++i])) <= 0) {
+                std::cerr << "Expected a positive thread count after --threads.";
+                return 1;
+            }
+        } else if (arg == "--gradient") {
+            gradient = true;
+        } else if (arg == "--serve") {
+            serve = true;
+        } else if (arg == "--socket") {
+            if (i + 1 >= argc) {
+                std::cerr << "Expected a path after --socket.";
+                return 1;
+            }
+            serve = true;
+            socket_path = argv[++i];
+        } else if (arg == "--batch") {
+            if (i + 1 >= argc) {
+                std::cerr << "Expected a job file after --batch.";
+                return 1;
+            }
+            batch_path = argv[++i];
+        } else if (arg == "--against") {
+            if (i + 1 >= argc) {
+                std::cerr << "Expected a mesh list after --against.";
+                return 1;
+            }
+            against_path = argv[++i];
+        } else if (arg == "--all-pairs") {
+            if (i + 1 >= argc) {
+                std::cerr << "Expected a mesh list after --all-pairs.";
+                return 1;
+            }
+            all_pairs_path = argv[++i];
+        } else if (arg == "--union") {
+            if (i + 1 >= argc) {
+                std::cerr << "Expected a mesh list after --union.";
+                return 1;
+            }
+            union_path = argv[++i];
+        } else if (arg == "--breakdown") {
+            if (i + 1 >= argc || ((breakdown = argv[++i]) != "components" && breakdown != "labels")) {
+                std::cerr << "Expected components or labels after --breakdown.";
+                return 1;
+            }
+        } else if (arg == "--cache-megabytes") {
+            if (i + 1 >= argc || (cache_megabytes = std::atol(argv[++i])) <= 0) {
+                std::cerr << "Expected a positive size after --cache-megabytes.";
+                return 1;
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    // server mode, requests are read line by line from stdin or the socket
+    if (serve) {
+        mesh::mesh_cache cache((std::size_t) cache_megabytes << 20);
+        std::string error;
+        if (socket_path.empty()) {
+            mesh::serve(std::cin, std::cout, cache);
+        } else if (!mesh::serve_socket(socket_path, cache, error)) {
+            std::cerr << "Could not listen on " << socket_path << ": " << error;
+            return 1;
+        }
+        return 0;
+    }
+
+    // batch mode, every line of the job file names two meshes, the results are printed in job order
+    if (!batch_path.empty()) {
+        std::ifstream jobs(batch_path);
+        if (!jobs) {
+            std::cerr << "Could not open " << batch_path << ".";
+            return 1;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mesh::batch_executor executor(2, 4, (std::size_t) cache_megabytes << 20);
+        std::vector<std::pair<std::string, std::future<mesh::batch_result>>> results;
+        std::string first, second;
+        while (jobs >> first >> second)
+            results.emplace_back(first + " " + second, executor.submit({first, second, options}));
+
+        for (auto &result : results) {
+            std::cout << result.first << " ";
+            try {
+                std::cout << result.second.get().volume << std::endl;
+            } catch (const std::exception &e) {
+                std::cout << "error: " << e.what() << std::endl;
+            }
+        }
+        std::chrono::duration<double> delta = std::chrono::steady_clock::now() - start;
+        std::cout << results.size() << " jobs, " << delta.count() << " seconds elapsed." << std::endl;
+        return 0;
+    }
+
+    // one against many, the reference is prepared once and every line of the list names another mesh
+    if (!against_path.empty()) {
+        std::ifstream list(against_path);
+        if (!list) {
+            std::cerr << "Could not open " << against_path << ".";
+            return 1;
+        }
+        if (paths.size() != 1) {
+            std::cerr << "Expected a single reference mesh with --against.";
+            return 1;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::shared_ptr<const mesh::prepared_mesh> reference;
+        try {
+            reference = mesh::load_prepared_mesh(paths[0]);
+        } catch (const std::exception &e) {
+            std::cerr << e.what();
+            return 1;
+        }
+
+        std::vector<std::string> others;
+        std::string other;
+        while (list >> other)
+            others.push_back(other);
+
+        mesh::one_vs_many(*reference, others, options, [&](std::size_t index, const mesh::batch_result &result) {
+            std::cout << others[index] << " ";
+            if (result.error.empty())
+                std::cout << result.volume << std::endl;
+            else
+                std::cout << "error: " << result.error << std::endl;
+        });
+        std::chrono::duration<double> delta = std::chrono::steady_clock::now() - start;
+        std::cout << others.size() << " pairs, " << delta.count() << " seconds elapsed." << std::endl;
+        return 0;
+    }
+
+    // every pair of a mesh set, printed as a symmetric sparse matrix in matrix market format
+    if (!all_pairs_path.empty()) {
+        std::ifstream list(all_pairs_path);
+        if (!list) {
+            std::cerr << "Could not open " << all_pairs_path << ".";
+            return 1;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<std::string> parts;
+        std::string part;
+        while (list >> part)
+            parts.push_back(part);
+
+        std::vector<std::shared_ptr<const mesh::prepared_mesh>> meshes(parts.size());
+        std::vector<std::string> errors(parts.size());
+        #pragma omp parallel for schedule(dynamic)
+        for (std::int64_t i = 0; i < (std::int64_t) parts.size(); ++i) {
+            try {
+                meshes[i] = mesh::load_prepared_mesh(parts[i]);
+            } catch (const std::exception &e) {
+                errors[i] = e.what();
+            }
+        }
+        for (const auto &error : errors) {
+            if (!error.empty()) {
+                std::cerr << error;
+                return 1;
+            }
+        }
+
+        std::vector<mesh::pair_volume> matrix;
+        try {
+            matrix = mesh::all_pairs(meshes, options);
+        } catch (const std::invalid_argument &e) {
+            std::cerr << e.what();
+            return 1;
+        }
+
+        // one based, the second index is the row so that the entries lie in the lower triangle
+        std::cout << "%%MatrixMarket matrix coordinate real symmetric" << std::endl;
+        for (std::size_t i = 0; i < parts.size(); ++i)
+            std::cout << "% " << i + 1 << " " << parts[i] << std::endl;
+        std::cout << parts.size() << " " << parts.size() << " " << matrix.size() << std::endl;
+        for (const auto &entry : matrix)
+            std::cout << entry.second + 1 << " " << entry.first + 1 << " " << entry.volume << std::endl;
+
+        std::chrono::duration<double> delta = std::chrono::steady_clock::now() - start;
+        std::cerr << parts.size() << " meshes, " << delta.count() << " seconds elapsed." << std::endl;
+        return 0;
+    }
+
+    // volume covered by any mesh of a set
+    if (!union_path.empty()) {
+        std::ifstream list(union_path);
+        if (!list) {
+            std::cerr << "Could not open " << union_path << ".";
+            return 1;
+        }
+
+        std::vector<std::string> parts;
+        std::string part;
+        while (list >> part)
+            parts.push_back(part);
+
+        std::vector<std::shared_ptr<const mesh::prepared_mesh>> meshes(parts.size());
+        std::vector<std::string> errors(parts.size());
+        #pragma omp parallel for schedule(dynamic)
+        for (std::int64_t i = 0; i < (std::int64_t) parts.size(); ++i) {
+            try {
+                meshes[i] = mesh::load_prepared_mesh(parts[i]);
+            } catch (const std::exception &e) {
+                errors[i] = e.what();
+            }
+        }
+        for (const auto &error : errors) {
+            if (!error.empty()) {
+                std::cerr << error;
+                return 1;
+            }
+        }
+
+        std::vector<const mesh::prepared_mesh *> operands;
+        for (const auto &mesh : meshes)
+            operands.push_back(mesh.get());
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        myfloat error_estimate;
+        myfloat volume = mesh::union_volume(operands, &error_estimate);
+        std::chrono::duration<double> delta = std::chrono::steady_clock::now() - start;
+
+        std::cout << "Union volume: " << volume << std::endl;
+        std::cout << "Error estimate: " << error_estimate << std::endl;
+        std::cout << parts.size() << " meshes, " << delta.count() << " seconds elapsed." << std::endl;
+        return 0;
+    }
+
+    // intersection volume of every pair of connected components or stl labels of two meshes
+    if (!breakdown.empty()) {
+        if (paths.size() != 2) {
+            std::cerr << "Expected two meshes with --breakdown.";
+            return 1;
+        }
+
+        mesh::prepared_mesh prepared[2];
+        std::vector<std::size_t> parts[2];
+        for (int i = 0; i < 2; ++i) {
+            std::vector<triangle> triangles;
+            std::vector<std::uint16_t> labels;
+            if (!mesh::load_mesh(paths[i], triangles, labels)) {
+                std::cerr << "Could not load " << paths[i] << ".";
+                return 1;
+            }
+            prepared[i] = mesh::prepare_mesh(triangles);
+            if (breakdown == "components")
+                mesh::connected_components(prepared[i].triangles, parts[i]);
+            else
+                parts[i].assign(labels.begin(), labels.end());
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<mesh::part_volume> volumes = mesh::intersection_breakdown(prepared[0], parts[0], prepared[1], parts[1]);
+        std::chrono::duration<double> delta = std::chrono::steady_clock::now() - start;
+
+        for (const auto &entry : volumes)
+            std::cout << entry.first_part << " " << entry.second_part << " " << entry.volume << std::endl;
+        std::cout << volumes.size() << " pairs, " << delta.count() << " seconds elapsed." << std::endl;
+        return 0;
+    }
+
+    if (paths.empty()) {
         std::cerr << "Invalid number of arguments supplied.";
         return 1;
-    } else if (argc == 2) {
-        first_mesh = mesh::load_mesh(argv[1]);
+    } else if (paths.size() >= 3) {
+        // common volume of all meshes in a single pass
+        std::vector<std::shared_ptr<const mesh::prepared_mesh>> meshes;
+        std::vector<const mesh::prepared_mesh *> operands;
+        try {
+            for (const auto &path : paths) {
+                meshes.push_back(mesh::load_prepared_mesh(path));
+                operands.push_back(meshes.back().get());
+            }
+        } catch (const std::exception &e) {
+            std::cerr << e.what();
+            return 1;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        myfloat error_estimate;
+        myfloat volume = mesh::intersection_volume(operands, &error_estimate);
+        std::chrono::duration<double> delta = std::chrono::steady_clock::now() - start;
+
+        std::cout << "Intersection volume: " << volume << std::endl;
+        std::cout << "Error estimate: " << error_estimate << std::endl;
+        std::cout << delta.count() << " seconds elapsed." << std::endl;
+    } else if (paths.size() == 1) {
+        first_mesh = mesh::load_mesh(paths[0]);
         myfloat volume = mesh::volume(first_mesh);
         std::cout << "Mesh volume: " << volume << std::endl;
     } else {
-        first_mesh = mesh::load_mesh(argv[1]);
-        second_mesh = mesh::load_mesh(argv[2]);
-
-        // compute intersection
-        center_pair_around_origin(first_mesh, second_mesh);
-        mesh::perturb_vertices(first_mesh);
-        mesh::perturb_vertices(second_mesh);
+        first_mesh = mesh::load_mesh(paths[0]);
+        second_mesh = mesh::load_mesh(paths[1]);
 
+        // compute intersection, the engines evaluate relative to the overlap of both meshes
         std::vector<ntriangle> first_mesh_normals = mesh::generate_normals(first_mesh);
         std::vector<ntriangle> second_mesh_normals = mesh::generate_normals(second_mesh);
 
         std::cout << "Preparation complete. Triangles: "
                   << first_mesh.size() << " vs " << second_mesh.size() << "." << std::endl;
 
-#ifdef MI_TIMED
-        std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
-#endif
-#ifdef MI_LOCALIZED
-        myfloat volume = mesh::localized_intersection_volume(first_mesh_normals, second_mesh_normals);
-#else
-        myfloat volume = mesh::intersection_volume(first_mesh_normals, second_mesh_normals);
-#endif
-#ifdef MI_TIMED
-        std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
-#endif
+        mesh::engine_report report;
+        myfloat volume;
+        try {
+            volume = mesh::intersection_volume(first_mesh_normals, second_mesh_normals, options, &report);
+        } catch (const std::invalid_argument &e) {
+            std::cerr << e.what();
+            return 1;
+        }
 
         std::cout << "Intersection volume: " << volume << std::endl;
-#ifdef MI_TIMED
-        std::chrono::duration<double> delta = end - start;
-        std::cout << delta.count() << " seconds elapsed." << std::endl;
-#endif
+        std::cout << "Error estimate: " << report.error_estimate << std::endl;
+        std::cout << "Engine: " << (report.engine == mesh::engine_type::automatic ? "none" : mesh::find_engine(report.engine).name) << std::endl;
+        std::cout << "Precision: " << mesh::precision_name(report.precision) << std::endl;
+        if (report.engine == mesh::engine_type::pipelined) {
+            const mesh::pipeline_stats &stats = report.stats;
+            std::cout << "Candidates: " << stats.candidates << " for " << stats.sides << " sides, "
+                      << stats.hits << " hits (" << 100 * stats.rejection_rate() << "% rejected)." << std::endl;
+            std::cout << "Classification: " << stats.classification_seconds << " s, broadphase: " << stats.broadphase_seconds
+                      << " s, narrowphase: " << stats.narrowphase_seconds << " s." << std::endl;
+        }
+        std::cout << report.seconds << " seconds elapsed." << std::endl;
+
+        // derivative with respect to moving the second mesh, rotations are about the centre of its bounding box
+        if (gradient) {
+            mesh::prepared_mesh first = mesh::prepare_mesh(first_mesh), second = mesh::prepare_mesh(second_mesh);
+            mesh::volume_gradient g;
+            mesh::intersection_volume_gradient(first, second, mymat4(1), (second.min + second.max) / myfloat(2), g);
+            std::cout << "Translation gradient: " << g.translation.x << " " << g.translation.y << " " << g.translation.z << std::endl;
+            std::cout << "Rotation gradient: " << g.rotation.x << " " << g.rotation.y << " " << g.rotation.z << std::endl;
+        }
     }
 
 #ifdef MI_VISUALIZE
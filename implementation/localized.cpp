@@ -1,37 +1,39 @@
 
+#include "classify.h"
 #include "evaluation.h"
+#include "localized.h"
 #include "mesh.h"
 
 #include <algorithm>
-#include <deque>
-#include <functional>
-#include <numeric>
+#include <cmath>
+#include <limits>
 
 #ifdef MI_LOCALIZED_CONSISTENCY_CHECKS
+#include <cstdlib>
+#include <iostream>
 #include <utility>
 #endif
 
 namespace mesh {
 
-    enum class vertex_location { unknown, inside, outside };
+    // the line is given relative to the origin, the triangles are translated on the fly
+    void localized_intersect_line_all_triangles(const std::vector<ntriangle> &triangles, const myvec &origin, const triangle_side &line,
+                                                eval::perturbation p, vertex_location &start_location, vertex_location &end_location,
+                                                eval::compensated_sum<myfloat> &accum) {
 
-    myfloat localized_intersect_line_all_triangles(const std::vector<ntriangle> &triangles, const triangle_side &line,
-                                                   vertex_location &start_location, vertex_location &end_location) {
-
-        myfloat accum = 0;
         eval::localized_intersection_count ic = eval::localized_intersection_count::zero();
 
         for (const auto &triangle : triangles) {
-            accum += eval::local_intersect_line_triangle(triangle, line, ic);
+            accum.add(eval::local_intersect_line_triangle(relative_to(triangle, origin), line, p, ic));
         }
 
         // no intersections on segment
         if (ic.on_segment == 0)
-            return accum;
+            return;
 
         // classify vertices
-        bool is_end_inside = ic.is_start_inside ^ (ic.on_segment % 2 == 1);
-        vertex_location local_start_location = ic.is_start_inside ? vertex_location::inside : vertex_location::outside;
+        bool is_end_inside = ic.is_start_inside() ^ (ic.on_segment % 2 == 1);
+        vertex_location local_start_location = ic.is_start_inside() ? vertex_location::inside : vertex_location::outside;
         vertex_location local_end_location = is_end_inside ? vertex_location::inside : vertex_location::outside;
 
 #ifdef MI_LOCALIZED_CONSISTENCY_CHECKS
@@ -47,45 +49,56 @@ namespace mesh {
 #endif
         start_location = local_start_location;
         end_location = local_end_location;
-
-        return accum;
     }
 
-    // this is quite messy and needs a rewrite (including sensible types)
-    using adjacency_list = std::vector<std::vector<std::size_t>>;
-    adjacency_list adjacency(std::size_t vertex_count, const std::vector<std::size_t> &unified_indices) {
-        adjacency_list al(vertex_count, std::vector<std::size_t>{});
+    // directed edges in compressed rows, counted first so that the buffers are only resized
+    void adjacency(std::size_t vertex_count, const std::vector<std::size_t> &unified_indices,
+                   std::vector<std::size_t> &offsets, std::vector<std::size_t> &neighbors) {
+        offsets.assign(vertex_count + 1, 0);
+        for (std::size_t i = 0; i < unified_indices.size(); ++i)
+            ++offsets[unified_indices[i] + 1];
+        for (std::size_t v = 0; v < vertex_count; ++v)
+            offsets[v + 1] += offsets[v];
 
+        neighbors.resize(unified_indices.size());
         for (std::size_t tri = 0; tri < unified_indices.size(); tri += 3) {
             for (std::size_t edge = 0; edge < 3; ++edge) {
                 std::size_t from = unified_indices[tri + edge];
                 std::size_t to = unified_indices[tri + (edge + 1) % 3];
 
-                al[from].push_back(to);
+                neighbors[offsets[from]++] = to;
             }
         }
 
-        return al;
+        // the fill advanced every offset to the start of the next row
+        for (std::size_t v = vertex_count; v > 0; --v)
+            offsets[v] = offsets[v - 1];
+        offsets[0] = 0;
     }
 
-    bool localized_asymetric_intersect(const std::vector<ntriangle> &triangles, const std::vector<ntriangle> &lines, myfloat &volume) {
-        myfloat accum = 0;
+    bool localized_asymetric_intersect(const std::vector<ntriangle> &triangles, const std::vector<ntriangle> &lines, const myvec &origin,
+                                       eval::perturbation p, localized_workspace &workspace, eval::compensated_sum<myfloat> &volume) {
+        eval::compensated_sum<myfloat> accum;
 
         // unify vertices
-        std::vector<myvec> unified_vertices;
-        std::vector<std::size_t> unified_indices;
-        mesh::unify_vertices(lines, unified_vertices, unified_indices);
+        std::vector<myvec> &unified_vertices = workspace.unified_vertices;
+        std::vector<std::size_t> &unified_indices = workspace.unified_indices;
+        unified_vertices.clear();
+        unified_indices.clear();
+        mesh::unify_vertices(lines, unified_vertices, unified_indices, workspace.unify);
 
-        std::vector<vertex_location> locations(unified_vertices.size(), vertex_location::unknown);
+        std::vector<vertex_location> &locations = workspace.locations;
+        locations.assign(unified_vertices.size(), vertex_location::unknown);
 
         for (std::size_t i = 0; i < lines.size(); ++i) {
+            ntriangle local = relative_to(lines[i], origin);
             // write to unified vertex representation
-            accum += localized_intersect_line_all_triangles(triangles, extract_side(lines[i], 0),
-                    locations[unified_indices[3 * i + 0]], locations[unified_indices[3 * i + 1]]);
-            accum += localized_intersect_line_all_triangles(triangles, extract_side(lines[i], 1),
-                    locations[unified_indices[3 * i + 1]], locations[unified_indices[3 * i + 2]]);
-            accum += localized_intersect_line_all_triangles(triangles, extract_side(lines[i], 2),
-                    locations[unified_indices[3 * i + 2]], locations[unified_indices[3 * i + 0]]);
+            localized_intersect_line_all_triangles(triangles, origin, extract_side(local, 0), p,
+                    locations[unified_indices[3 * i + 0]], locations[unified_indices[3 * i + 1]], accum);
+            localized_intersect_line_all_triangles(triangles, origin, extract_side(local, 1), p,
+                    locations[unified_indices[3 * i + 1]], locations[unified_indices[3 * i + 2]], accum);
+            localized_intersect_line_all_triangles(triangles, origin, extract_side(local, 2), p,
+                    locations[unified_indices[3 * i + 2]], locations[unified_indices[3 * i + 0]], accum);
         }
 
         std::size_t intersections = std::count_if(locations.begin(), locations.end(), [](const vertex_location &vl){
@@ -107,19 +120,20 @@ namespace mesh {
         std::cout << std::endl;
 #endif
 
-        // complete vertex classification by traversing adjacency graph
-        adjacency_list al = adjacency(unified_vertices.size(), unified_indices);
+        // complete vertex classification by traversing adjacency graph, the order of the flood fill does not matter
+        adjacency(unified_vertices.size(), unified_indices, workspace.adjacency_offsets, workspace.adjacency);
 
-        std::vector<bool> visited(unified_vertices.size(), false);
+        std::vector<bool> &visited = workspace.visited;
+        visited.assign(unified_vertices.size(), false);
 
-        std::deque<std::size_t> deque;
+        std::vector<std::size_t> &stack = workspace.stack;
         for (std::size_t i = 0; i < locations.size(); ++i) {
-            deque.clear();
+            stack.clear();
 
-            deque.push_back(i);
-            while (!deque.empty()) {
-                std::size_t vertex_index = deque.front();
-                deque.pop_front();
+            stack.push_back(i);
+            while (!stack.empty()) {
+                std::size_t vertex_index = stack.back();
+                stack.pop_back();
 
                 if (visited[vertex_index])
                     continue;
@@ -130,12 +144,13 @@ namespace mesh {
 
                 visited[vertex_index] = true;
 
-                for (std::size_t neighbor : al[vertex_index]) {
+                for (std::size_t k = workspace.adjacency_offsets[vertex_index]; k < workspace.adjacency_offsets[vertex_index + 1]; ++k) {
+                    std::size_t neighbor = workspace.adjacency[k];
                     if (locations[neighbor] != vertex_location::unknown)
                         continue;
 
                     locations[neighbor] = vertex_location::inside;
-                    deque.push_back(neighbor);
+                    stack.push_back(neighbor);
                 }
             }
         }
@@ -153,52 +168,56 @@ namespace mesh {
 
         // evaluate vertex classification
         for (std::size_t i = 0; i < lines.size(); ++i) {
-            accum += eval::evaluate_line_intersection(extract_side(lines[i], 0),
+            ntriangle local = relative_to(lines[i], origin);
+            accum.add(eval::evaluate_line_intersection(extract_side(local, 0),
                     locations[unified_indices[3 * i + 0]] == vertex_location::inside,
-                    locations[unified_indices[3 * i + 1]] == vertex_location::inside);
-            accum += eval::evaluate_line_intersection(extract_side(lines[i], 1),
+                    locations[unified_indices[3 * i + 1]] == vertex_location::inside));
+            accum.add(eval::evaluate_line_intersection(extract_side(local, 1),
                     locations[unified_indices[3 * i + 1]] == vertex_location::inside,
-                    locations[unified_indices[3 * i + 2]] == vertex_location::inside);
-            accum += eval::evaluate_line_intersection(extract_side(lines[i], 2),
+                    locations[unified_indices[3 * i + 2]] == vertex_location::inside));
+            accum.add(eval::evaluate_line_intersection(extract_side(local, 2),
                     locations[unified_indices[3 * i + 2]] == vertex_location::inside,
-                    locations[unified_indices[3 * i + 0]] == vertex_location::inside);
+                    locations[unified_indices[3 * i + 0]] == vertex_location::inside));
         }
-        volume += accum;
+        volume.add(accum);
         return true;
     }
 
-    // this could be moved to mesh.cpp
-    bool is_inside(const std::vector<ntriangle> &inner, const std::vector<ntriangle> &outer) {
-
-        triangle_side inner_side = extract_side(inner[0], 0);
-        auto count_before = [&](std::size_t count, const ntriangle &tri) -> std::size_t {
-            myfloat scalar;
-            if (!eval::solve_intersection(tri, inner_side, scalar))
-                return count;
-            return scalar < 0 ? count + 1 : count;
-        };
+    bool is_inside(const std::vector<ntriangle> &inner, const std::vector<ntriangle> &outer, eval::perturbation p) {
+        return projected_classifier(outer, p).is_inside(inner[0].a);
+    }
 
-        return std::accumulate(outer.begin(), outer.end(), std::size_t(), count_before) % 2 == 1;
+    myfloat localized_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                          myfloat *error_estimate) {
+        localized_workspace workspace;
+        return localized_intersection_volume(first_mesh, second_mesh, workspace, error_estimate);
     }
 
-    myfloat localized_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh) {
-        if (first_mesh.empty() || second_mesh.empty())
-            return 0;
+    myfloat localized_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                          localized_workspace &workspace, myfloat *error_estimate) {
+        myfloat volume = 0, error = 0;
 
         // check if meshes intersect
-        myfloat accum = 0;
-        bool does_intersect = localized_asymetric_intersect(first_mesh, second_mesh, accum)
-                            | localized_asymetric_intersect(second_mesh, first_mesh, accum);
-
-        if (does_intersect)
-            return accum / 6;
-
-        if (is_inside(first_mesh, second_mesh))
-            return mesh::volume(first_mesh);
-
-        if (is_inside(second_mesh, first_mesh))
-            return mesh::volume(second_mesh);
+        myvec origin = local_origin(first_mesh, second_mesh);
+        eval::compensated_sum<myfloat> accum;
+        bool does_intersect = !first_mesh.empty() && !second_mesh.empty()
+                            && (localized_asymetric_intersect(first_mesh, second_mesh, origin, eval::lines_of_second_mesh, workspace, accum)
+                                | localized_asymetric_intersect(second_mesh, first_mesh, origin, eval::lines_of_first_mesh, workspace, accum));
+
+        if (does_intersect) {
+            volume = accum.value() / 6;
+            error = accum.error_estimate() / 6;
+        } else if (!first_mesh.empty() && !second_mesh.empty()) {
+            // a contained mesh is summed directly, only the rounding of the result is reported
+            if (is_inside(first_mesh, second_mesh, eval::lines_of_first_mesh))
+                volume = mesh::volume(first_mesh);
+            else if (is_inside(second_mesh, first_mesh, eval::lines_of_second_mesh))
+                volume = mesh::volume(second_mesh);
+            error = std::numeric_limits<myfloat>::epsilon() * std::abs(volume);
+        }
 
-        return 0;
+        if (error_estimate)
+            *error_estimate = error;
+        return volume;
     }
 }
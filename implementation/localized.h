@@ -2,11 +2,31 @@
 #define MI_LOCALIZED_H
 
 #include "globals.h"
+#include "mesh.h"
 
 #include <vector>
 
 namespace mesh {
-    myfloat localized_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh);
+    enum class vertex_location { unknown, inside, outside };
+
+    // buffers of the localized engine, reusing them avoids the allocations of repeated queries
+    struct localized_workspace {
+        unify_workspace unify;
+        std::vector<myvec> unified_vertices;
+        std::vector<std::size_t> unified_indices;
+        std::vector<vertex_location> locations;
+        // the neighbours of vertex v are adjacency[adjacency_offsets[v]] up to adjacency[adjacency_offsets[v + 1]]
+        std::vector<std::size_t> adjacency_offsets;
+        std::vector<std::size_t> adjacency;
+        std::vector<bool> visited;
+        std::vector<std::size_t> stack;
+    };
+
+    // error_estimate receives a first order estimate of the rounding error of the volume
+    myfloat localized_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                          myfloat *error_estimate = nullptr);
+    myfloat localized_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                          localized_workspace &workspace, myfloat *error_estimate = nullptr);
 }
 
 #endif
@@ -1,10 +1,11 @@
 
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
 #include <exception>
 #include <fstream>
 #include <limits>
-#include <random>
 #include <unordered_map>
 
 #include "evaluation.h"
@@ -14,7 +15,8 @@
 
 namespace mesh {
 
-bool load_binary_stl_file(std::ifstream &instream, std::vector<triangle> &t) {
+// labels may be null, the attribute bytes are kept as the label of each triangle
+bool load_binary_stl_file(std::ifstream &instream, std::vector<triangle> &t, std::vector<std::uint16_t> *labels) {
     instream.seekg(80, std::ios_base::beg); // skip ascii header
     int trinum = 0;
     instream.read((char *) &trinum, 4); // number of vertices
@@ -30,12 +32,16 @@ bool load_binary_stl_file(std::ifstream &instream, std::vector<triangle> &t) {
             buf[i] = {(myfloat) v[0], (myfloat) v[1], (myfloat) v[2]};
         }
         t.emplace_back(buf[0], buf[1], buf[2]);
-        instream.read((char *) &tmp, 2);
+        std::uint16_t attribute = 0;
+        instream.read((char *) &attribute, 2);
+        if (labels)
+            labels->push_back(attribute);
     }
     return true;
 }
 
-bool load_ascii_stl_file(std::ifstream &instream, std::vector<triangle> &t) {
+// ascii files carry no attributes, every triangle is labelled 0
+bool load_ascii_stl_file(std::ifstream &instream, std::vector<triangle> &t, std::vector<std::uint16_t> *labels) {
     // ignore first line "solid xxx"
     instream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     std::string sentinel, ignore;
@@ -50,13 +56,15 @@ bool load_ascii_stl_file(std::ifstream &instream, std::vector<triangle> &t) {
             buf[i] = {(myfloat) x, (myfloat) y, (myfloat) z};
         }
         t.emplace_back(buf[0], buf[1], buf[2]);
+        if (labels)
+            labels->push_back(0);
         instream >> ignore >> ignore; // "endloop", "endfacet"
     }
     return true;
 }
 
 
-bool load_stl_file(const std::string &filename, std::vector<triangle> &target) {
+bool load_stl_file(const std::string &filename, std::vector<triangle> &target, std::vector<std::uint16_t> *labels) {
     std::ifstream instream(filename, std::ios::binary);
     if (!instream) return false;
 
@@ -64,24 +72,32 @@ bool load_stl_file(const std::string &filename, std::vector<triangle> &target) {
     instream.read(first, 5);
     instream.seekg(0);
     if (std::string(first) != "solid") {
-        return load_binary_stl_file(instream, target);
+        return load_binary_stl_file(instream, target, labels);
     } else {
-        return load_ascii_stl_file(instream, target);
+        return load_ascii_stl_file(instream, target, labels);
     }
 }
 
 
-bool load_mesh(const std::string &path, std::vector<triangle> &target) {
+bool load_mesh_impl(const std::string &path, std::vector<triangle> &target, std::vector<std::uint16_t> *labels) {
     std::string::size_type index = path.find_last_of('.');
     if (index == std::string::npos)
         return false;
     std::string suffix = path.substr(index + 1);
     if (suffix == "stl") {
-        return load_stl_file(path, target);
+        return load_stl_file(path, target, labels);
     }
     return false;
 }
 
+bool load_mesh(const std::string &path, std::vector<triangle> &target) {
+    return load_mesh_impl(path, target, nullptr);
+}
+
+bool load_mesh(const std::string &path, std::vector<triangle> &target, std::vector<std::uint16_t> &labels) {
+    return load_mesh_impl(path, target, &labels);
+}
+
 std::vector<triangle> load_mesh(const std::string &path) {
     std::vector<triangle> buffer;
     if (!load_mesh(path, buffer))
@@ -130,72 +146,148 @@ struct pair_hash {
 
 
 template <typename triangle_t>
-void unify_impl(const std::vector<triangle_t> &input, std::vector<myvec> &vertices, std::vector<std::size_t> &indices, int hash_cutoff) {
+void bounding_box_impl(const std::vector<triangle_t> &mesh, myvec &min, myvec &max) {
+    min = myvec(std::numeric_limits<myfloat>::infinity());
+    max = myvec(-std::numeric_limits<myfloat>::infinity());
 
-    myfloat pre_cutoff_factor = std::pow(myfloat(10), hash_cutoff);
-    myfloat post_cutoff_factor = 1 / pre_cutoff_factor;
-    // assume every vertex will be shared by at least 3 triangles
-    auto bucket_count = input.size() / 3;
+    for (const auto &t : mesh) {
+        min = glm::min(min, glm::min(t.a, glm::min(t.b, t.c)));
+        max = glm::max(max, glm::max(t.a, glm::max(t.b, t.c)));
+    }
+}
 
-    std::unordered_map<const myvec, std::size_t, vector_hash<const myvec>> vertices_to_index(bucket_count);
+void bounding_box(const std::vector<triangle> &mesh, myvec &min, myvec &max) {
+    bounding_box_impl(mesh, min, max);
+}
+
+void bounding_box(const std::vector<ntriangle> &mesh, myvec &min, myvec &max) {
+    bounding_box_impl(mesh, min, max);
+}
 
+myvec triangle_min(const ntriangle &t) {
+    return glm::min(t.a, glm::min(t.b, t.c));
+}
+
+myvec triangle_max(const ntriangle &t) {
+    return glm::max(t.a, glm::max(t.b, t.c));
+}
+
+myvec local_origin(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh) {
+    if (first_mesh.empty() || second_mesh.empty())
+        return myvec(0);
+
+    myvec first_min, first_max, second_min, second_max;
+    bounding_box(first_mesh, first_min, first_max);
+    bounding_box(second_mesh, second_min, second_max);
+
+    // lies between both boxes if they do not overlap
+    myvec centre = (glm::max(first_min, second_min) + glm::min(first_max, second_max)) / myfloat(2);
+
+    // snap to a coarse power of two grid, coordinates representable in the lower precision stay representable
+    myvec extent = glm::max(first_max, second_max) - glm::min(first_min, second_min);
+    myfloat largest = std::max({extent.x, extent.y, extent.z});
+    if (!(largest > 0) || !std::isfinite(largest))
+        return centre;
+
+    myfloat step = std::exp2(std::floor(std::log2(largest)) - 4);
+    return glm::round(centre / step) * step;
+}
+
+std::vector<std::size_t> overlapping_triangles(const std::vector<ntriangle> &mesh, const myvec &min, const myvec &max) {
+    std::vector<std::size_t> indices;
+    for (std::size_t i = 0; i < mesh.size(); ++i) {
+        const ntriangle &t = mesh[i];
+        if (!glm::any(glm::greaterThan(min, glm::max(t.a, glm::max(t.b, t.c)))) && !glm::any(glm::lessThan(max, glm::min(t.a, glm::min(t.b, t.c)))))
+            indices.push_back(i);
+    }
+    return indices;
+}
+
+template <typename triangle_t>
+void unify_impl(const std::vector<triangle_t> &input, std::vector<myvec> &vertices, std::vector<std::size_t> &indices,
+                unify_workspace &workspace, int hash_cutoff) {
+
+    myvec min, max;
+    bounding_box(input, min, max);
+
+    // vertices are snapped to a grid relative to the bounding box, so the cutoff does not depend on the scale of the mesh
+    myvec extent = max - min;
+    myfloat cell_size = std::max({extent.x, extent.y, extent.z}) * std::pow(myfloat(10), -hash_cutoff);
+    myfloat inv_cell_size = cell_size > 0 ? 1 / cell_size : 1;
+    // open addressing over flat buffers, so a reused workspace does not allocate,
+    // the table is kept at most half full with 3 vertices per triangle
+    std::size_t slot_count = 1;
+    while (slot_count < input.size() * 6)
+        slot_count *= 2;
+    const std::size_t empty = std::numeric_limits<std::size_t>::max();
+    workspace.slots.assign(slot_count, empty);
+    workspace.cells.clear();
+
+    // indices continue after the vertices already present
+    const std::size_t first_index = vertices.size();
+    vector_hash<myvec> hash;
     for (const triangle &triangle : input) {
         for (const auto &vertex : triangle) {
-            myvec cutoff = post_cutoff_factor * glm::round(vertex * pre_cutoff_factor);
-            auto lookup = vertices_to_index.find(cutoff);
+            myvec cutoff = glm::round((vertex - min) * inv_cell_size);
 
-            if (lookup == vertices_to_index.end()) {
-                std::size_t next_index = vertices.size();
+            std::size_t slot = hash(cutoff) & (slot_count - 1);
+            while (workspace.slots[slot] != empty && workspace.cells[workspace.slots[slot]] != cutoff)
+                slot = (slot + 1) & (slot_count - 1);
 
+            if (workspace.slots[slot] == empty) {
                 // insert original vertex
+                workspace.slots[slot] = workspace.cells.size();
+                workspace.cells.push_back(cutoff);
                 vertices.push_back(vertex);
-                indices.push_back(next_index);
-                vertices_to_index[cutoff] = next_index;
-            } else {
-                indices.push_back(lookup->second);
             }
+            indices.push_back(first_index + workspace.slots[slot]);
         }
     }
 }
 void unify_vertices(const std::vector<triangle> &input, std::vector<myvec> &vertices, std::vector<std::size_t> &indices, int hash_cutoff) {
-    unify_impl(input, vertices, indices, hash_cutoff);
+    unify_workspace workspace;
+    unify_impl(input, vertices, indices, workspace, hash_cutoff);
 }
 void unify_vertices(const std::vector<ntriangle> &input, std::vector<myvec> &vertices, std::vector<std::size_t> &indices, int hash_cutoff) {
-    unify_impl(input, vertices, indices, hash_cutoff);
+    unify_workspace workspace;
+    unify_impl(input, vertices, indices, workspace, hash_cutoff);
 }
-
-
-// see https://en.wikipedia.org/wiki/Single-precision_floating-point_format
-float oom(float in) {
-    if (in == 0) return 1;
-    std::uint32_t binary = *reinterpret_cast<std::uint32_t *>(&in);
-    std::uint32_t exponent = binary & 0x7F800000u;
-    return *reinterpret_cast<float *>(&exponent);
+void unify_vertices(const std::vector<ntriangle> &input, std::vector<myvec> &vertices, std::vector<std::size_t> &indices,
+                    unify_workspace &workspace, int hash_cutoff) {
+    unify_impl(input, vertices, indices, workspace, hash_cutoff);
 }
-// see https://en.wikipedia.org/wiki/Double-precision_floating-point_format
-double oom(double in) {
-    if (in == 0) return 1;
-    std::uint64_t binary = *reinterpret_cast<std::uint64_t *>(&in);
-    std::uint64_t exponent = binary & 0x7FF0000000000000ull;
-    return *reinterpret_cast<double *>(&exponent);
-}
-
-void perturb_vertices(std::vector<triangle> &mesh, myfloat eps) {
-    std::mt19937 gen(std::random_device{}());
-    std::uniform_real_distribution<myfloat> dis(-eps, eps);
-
-    std::vector<myvec> unified_vertices;
-    std::vector<std::size_t> unified_indices;
-    unify_vertices(mesh, unified_vertices, unified_indices);
 
-    for (auto &v : unified_vertices)
-        v += myvec(dis(gen) * oom(v.x), dis(gen) * oom(v.y), dis(gen) * oom(v.z));
+std::size_t connected_components(const std::vector<ntriangle> &mesh, std::vector<std::size_t> &components) {
+    std::vector<myvec> vertices;
+    std::vector<std::size_t> indices;
+    unify_vertices(mesh, vertices, indices);
+
+    // union find over the unified vertices, every triangle joins its three vertices
+    std::vector<std::size_t> parent(vertices.size());
+    for (std::size_t i = 0; i < parent.size(); ++i)
+        parent[i] = i;
+    auto root = [&](std::size_t i) {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    };
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        std::size_t a = root(indices[i]);
+        parent[root(indices[i + 1])] = a;
+        parent[root(indices[i + 2])] = a;
+    }
 
+    const std::size_t unassigned = std::numeric_limits<std::size_t>::max();
+    std::vector<std::size_t> numbers(vertices.size(), unassigned);
+    std::size_t count = 0;
+    components.resize(mesh.size());
     for (std::size_t i = 0; i < mesh.size(); ++i) {
-        mesh[i].a = unified_vertices[unified_indices[3 * i]];
-        mesh[i].b = unified_vertices[unified_indices[3 * i + 1]];
-        mesh[i].c = unified_vertices[unified_indices[3 * i + 2]];
+        std::size_t &number = numbers[root(indices[3 * i])];
+        if (number == unassigned)
+            number = count++;
+        components[i] = number;
     }
+    return count;
 }
 
 
@@ -280,6 +372,48 @@ void transform(const mymat4 &transformation, std::vector<triangle> &mesh) {
     }
 }
 
+bool is_rigid(const mymat4 &transformation) {
+    const myfloat tolerance = std::sqrt(std::numeric_limits<myfloat>::epsilon());
+    mymat rotation(transformation);
+    mymat deviation = glm::transpose(rotation) * rotation - mymat(1);
+    for (int i = 0; i < 3; ++i) {
+        if (glm::any(glm::greaterThan(glm::abs(deviation[i]), myvec(tolerance))) || transformation[i][3] != 0)
+            return false;
+    }
+    return glm::determinant(rotation) > 0 && transformation[3][3] == 1
+           && !glm::any(glm::isnan(myvec(transformation[3]))) && !glm::any(glm::isinf(myvec(transformation[3])));
+}
+
+mymat4 inverse_rigid(const mymat4 &pose) {
+    mymat rotation = glm::transpose(mymat(pose));
+    mymat4 inverse(rotation);
+    inverse[3] = myvec4(-(rotation * myvec(pose[3])), 1);
+    return inverse;
+}
+
+void transform_rigid(const mymat4 &pose, const std::vector<ntriangle> &mesh, std::vector<ntriangle> &result) {
+    mymat rotation(pose);
+    myvec translation(pose[3]);
+    result.clear();
+    result.reserve(mesh.size());
+    for (const auto &t : mesh)
+        result.emplace_back(rotation * t.a + translation, rotation * t.b + translation, rotation * t.c + translation, rotation * t.n);
+}
+
+void transform_bounding_box(const mymat4 &pose, const myvec &min, const myvec &max, myvec &posed_min, myvec &posed_max) {
+    // the inverted box of an empty mesh stays empty
+    if (glm::any(glm::lessThan(max, min))) {
+        posed_min = min, posed_max = max;
+        return;
+    }
+    mymat rotation(pose);
+    myvec centre = rotation * ((min + max) / myfloat(2)) + myvec(pose[3]);
+    mymat magnitude(glm::abs(rotation[0]), glm::abs(rotation[1]), glm::abs(rotation[2]));
+    myvec extent = magnitude * ((max - min) / myfloat(2));
+    posed_min = centre - extent;
+    posed_max = centre + extent;
+}
+
 std::vector<triangle> make_tetrahedron(const mymat4 &transformation) {
     std::vector<triangle> tetrahedron = {
             { {0, 0, 0}, {0, 0, 1}, {0, 1, 0} },
@@ -3,6 +3,7 @@
 
 #include "globals.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -11,6 +12,14 @@
 namespace mesh {
 
 void transform(const mymat4 &transformation, std::vector<triangle> &mesh);
+
+// rotation and translation only, up to rounding
+bool is_rigid(const mymat4 &transformation);
+mymat4 inverse_rigid(const mymat4 &pose);
+// normals are rotated along, a rigid pose keeps them normalized
+void transform_rigid(const mymat4 &pose, const std::vector<ntriangle> &mesh, std::vector<ntriangle> &result);
+// axis aligned box of the posed box, contains the posed mesh
+void transform_bounding_box(const mymat4 &pose, const myvec &min, const myvec &max, myvec &posed_min, myvec &posed_max);
 void generate_normals(std::vector<ntriangle> &out, const std::vector<triangle> &in);
 std::vector<ntriangle> generate_normals(const std::vector<triangle> &in);
 
@@ -23,22 +32,68 @@ std::vector<triangle> make_axis_aligned_unit_cube(const mymat4 &transformation =
 
 bool load_mesh(const std::string &path, std::vector<triangle> &target);
 std::vector<triangle> load_mesh(const std::string &path);
+// the attribute bytes of binary stl files as one label per triangle
+bool load_mesh(const std::string &path, std::vector<triangle> &target, std::vector<std::uint16_t> &labels);
 
 
-template <typename float_t> struct default_perturbation {};
+// vertices are merged if they agree to hash_cutoff decimal digits relative to the extent of the mesh
+constexpr int sane_hash_cutoff = 5;
 
-template <> struct default_perturbation<float> {
-    static constexpr float eps() { return 1e-5f; }
-};
-template <> struct default_perturbation<double> {
-    static constexpr double eps() { return 1e-10; }
+// scratch buffers of unify_vertices, reusing them avoids the allocations of repeated calls
+struct unify_workspace {
+    std::vector<std::size_t> slots;
+    std::vector<myvec> cells;
 };
 
-constexpr int sane_hash_cutoff = 5;
-
 void unify_vertices(const std::vector<triangle> &input, std::vector<myvec> &vertices, std::vector<std::size_t> &indices, int hash_cutoff = sane_hash_cutoff);
 void unify_vertices(const std::vector<ntriangle> &input, std::vector<myvec> &vertices, std::vector<std::size_t> &indices, int hash_cutoff = sane_hash_cutoff);
-void perturb_vertices(std::vector<triangle> &mesh, myfloat eps = default_perturbation<myfloat>::eps());
+void unify_vertices(const std::vector<ntriangle> &input, std::vector<myvec> &vertices, std::vector<std::size_t> &indices,
+                    unify_workspace &workspace, int hash_cutoff = sane_hash_cutoff);
+
+// triangles sharing a unified vertex belong to the same component, the components are numbered in the order of
+// their first triangle. returns the number of components
+std::size_t connected_components(const std::vector<ntriangle> &mesh, std::vector<std::size_t> &components);
+
+// empty meshes yield an inverted box of infinite extent
+void bounding_box(const std::vector<triangle> &mesh, myvec &min, myvec &max);
+void bounding_box(const std::vector<ntriangle> &mesh, myvec &min, myvec &max);
+
+// corners of the bounding box of a single triangle
+myvec triangle_min(const ntriangle &t);
+myvec triangle_max(const ntriangle &t);
+
+// centre of the overlap of both bounding boxes, the engines evaluate relative to it so that
+// parts far from the origin keep their precision
+myvec local_origin(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh);
+
+// indices of the triangles whose bounding box overlaps [min, max], in mesh order
+std::vector<std::size_t> overlapping_triangles(const std::vector<ntriangle> &mesh, const myvec &min, const myvec &max);
+
+template <typename float_t>
+MI_SHARED
+basic_ntriangle<float_t> relative_to(const basic_ntriangle<float_t> &t, const basic_vec<float_t> &origin) {
+    return basic_ntriangle<float_t>(t.a - origin, t.b - origin, t.c - origin, t.n);
+}
+
+// the translation is applied before the conversion, so it does not lose precision
+template <typename to_t, typename from_t>
+void convert_precision(const std::vector<basic_ntriangle<from_t>> &mesh, std::vector<basic_ntriangle<to_t>> &result,
+                       const basic_vec<from_t> &origin = basic_vec<from_t>(0)) {
+    result.clear();
+    result.reserve(mesh.size());
+    for (const auto &t : mesh) {
+        basic_ntriangle<from_t> local = relative_to(t, origin);
+        result.emplace_back(basic_vec<to_t>(local.a), basic_vec<to_t>(local.b), basic_vec<to_t>(local.c), basic_vec<to_t>(local.n));
+    }
+}
+
+template <typename to_t, typename from_t>
+std::vector<basic_ntriangle<to_t>> convert_precision(const std::vector<basic_ntriangle<from_t>> &mesh,
+                                                     const basic_vec<from_t> &origin = basic_vec<from_t>(0)) {
+    std::vector<basic_ntriangle<to_t>> result;
+    convert_precision(mesh, result, origin);
+    return result;
+}
 
 void find_opposing_indices(std::vector<std::size_t> &opposing_index, const std::vector<std::size_t> &indices);
 
@@ -0,0 +1,227 @@
+
+#include "include/meshvolume.h"
+
+#include "engine.h"
+#include "mesh.h"
+#include "multi.h"
+
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct mv_mesh {
+    std::vector<triangle> triangles;
+};
+
+struct mv_prepared_mesh {
+    mesh::prepared_mesh prepared;
+};
+
+namespace mesh {
+namespace c_api {
+
+    thread_local std::string last_error;
+
+    mv_status fail(mv_status status, const std::string &message) {
+        last_error = message;
+        return status;
+    }
+
+    // exceptions must not cross the c interface
+    template <typename function_t>
+    mv_status guarded(function_t &&function) {
+        try {
+            return function();
+        } catch (const std::bad_alloc &) {
+            return fail(MV_INTERNAL_ERROR, "Out of memory.");
+        } catch (const std::invalid_argument &e) {
+            return fail(MV_UNAVAILABLE, e.what());
+        } catch (const std::exception &e) {
+            return fail(MV_INTERNAL_ERROR, e.what());
+        }
+    }
+
+    bool convert_options(const mv_options *in, mesh::options &out) {
+        if (!in)
+            return true;
+
+        switch (in->engine) {
+            case MV_ENGINE_AUTO: out.engine = mesh::engine_type::automatic; break;
+            case MV_ENGINE_BRUTE_FORCE: out.engine = mesh::engine_type::brute_force; break;
+            case MV_ENGINE_PIPELINED: out.engine = mesh::engine_type::pipelined; break;
+            case MV_ENGINE_LOCALIZED: out.engine = mesh::engine_type::localized; break;
+            case MV_ENGINE_ACCELERATED: out.engine = mesh::engine_type::accelerated; break;
+            case MV_ENGINE_CONVEX: out.engine = mesh::engine_type::convex; break;
+            default: return false;
+        }
+
+        switch (in->precision) {
+            case MV_PRECISION_DEFAULT: out.precision = mesh::default_precision; break;
+            case MV_PRECISION_SINGLE: out.precision = mesh::precision::single_precision; break;
+            case MV_PRECISION_DOUBLE: out.precision = mesh::precision::double_precision; break;
+            case MV_PRECISION_MIXED: out.precision = mesh::precision::mixed_precision; break;
+            case MV_PRECISION_FIXED: out.precision = mesh::precision::fixed_point; break;
+            default: return false;
+        }
+
+        if (in->threads < 0)
+            return false;
+        out.threads = in->threads;
+        return true;
+    }
+}
+}
+
+extern "C" {
+
+using namespace mesh::c_api;
+
+const char *mv_last_error(void) {
+    return last_error.c_str();
+}
+
+mv_status mv_load(const char *path, mv_mesh **handle) {
+    if (!path || !handle)
+        return fail(MV_INVALID_ARGUMENT, "Null argument.");
+
+    return guarded([&]{
+        mv_mesh *result = new mv_mesh;
+        if (!mesh::load_mesh(path, result->triangles)) {
+            delete result;
+            return fail(MV_IO_ERROR, std::string("Could not load ") + path + ".");
+        }
+        *handle = result;
+        return MV_OK;
+    });
+}
+
+mv_status mv_create(const double *vertices, size_t triangle_count, mv_mesh **handle) {
+    if ((!vertices && triangle_count) || !handle)
+        return fail(MV_INVALID_ARGUMENT, "Null argument.");
+
+    return guarded([&]{
+        mv_mesh *result = new mv_mesh;
+        result->triangles.reserve(triangle_count);
+        for (size_t i = 0; i < triangle_count; ++i) {
+            const double *v = vertices + 9 * i;
+            result->triangles.emplace_back(myvec(v[0], v[1], v[2]), myvec(v[3], v[4], v[5]), myvec(v[6], v[7], v[8]));
+        }
+        *handle = result;
+        return MV_OK;
+    });
+}
+
+void mv_free(mv_mesh *handle) {
+    delete handle;
+}
+
+size_t mv_triangle_count(const mv_mesh *handle) {
+    return handle ? handle->triangles.size() : 0;
+}
+
+mv_status mv_volume(const mv_mesh *handle, double *volume) {
+    if (!handle || !volume)
+        return fail(MV_INVALID_ARGUMENT, "Null argument.");
+
+    *volume = mesh::volume(handle->triangles);
+    return MV_OK;
+}
+
+mv_status mv_prepare(const mv_mesh *handle, mv_prepared_mesh **prepared) {
+    if (!handle || !prepared)
+        return fail(MV_INVALID_ARGUMENT, "Null argument.");
+
+    return guarded([&]{
+        *prepared = new mv_prepared_mesh {mesh::prepare_mesh(handle->triangles)};
+        return MV_OK;
+    });
+}
+
+void mv_free_prepared(mv_prepared_mesh *prepared) {
+    delete prepared;
+}
+
+mv_status mv_intersection_volume(const mv_prepared_mesh *first, const mv_prepared_mesh *second, const mv_options *options,
+                                 double *volume, double *error_estimate) {
+    if (!first || !second || !volume)
+        return fail(MV_INVALID_ARGUMENT, "Null argument.");
+
+    mesh::options opts;
+    if (!convert_options(options, opts))
+        return fail(MV_INVALID_ARGUMENT, "Invalid options.");
+
+    return guarded([&]{
+        mesh::engine_report report;
+        *volume = mesh::intersection_volume(first->prepared, second->prepared, opts, &report);
+        if (error_estimate)
+            *error_estimate = report.error_estimate;
+        return MV_OK;
+    });
+}
+
+mv_status mv_intersection_volume_many(const mv_prepared_mesh *const *meshes, size_t count, double *volume, double *error_estimate) {
+    if ((!meshes && count) || !volume)
+        return fail(MV_INVALID_ARGUMENT, "Null argument.");
+
+    std::vector<const mesh::prepared_mesh *> operands;
+    for (size_t i = 0; i < count; ++i) {
+        if (!meshes[i])
+            return fail(MV_INVALID_ARGUMENT, "Null argument.");
+        operands.push_back(&meshes[i]->prepared);
+    }
+
+    return guarded([&]{
+        myfloat estimate;
+        *volume = mesh::intersection_volume(operands, &estimate);
+        if (error_estimate)
+            *error_estimate = estimate;
+        return MV_OK;
+    });
+}
+
+mv_status mv_union_volume(const mv_prepared_mesh *const *meshes, size_t count, double *volume, double *error_estimate) {
+    if ((!meshes && count) || !volume)
+        return fail(MV_INVALID_ARGUMENT, "Null argument.");
+
+    std::vector<const mesh::prepared_mesh *> operands;
+    for (size_t i = 0; i < count; ++i) {
+        if (!meshes[i])
+            return fail(MV_INVALID_ARGUMENT, "Null argument.");
+        operands.push_back(&meshes[i]->prepared);
+    }
+
+    return guarded([&]{
+        myfloat estimate;
+        *volume = mesh::union_volume(operands, &estimate);
+        if (error_estimate)
+            *error_estimate = estimate;
+        return MV_OK;
+    });
+}
+
+mv_status mv_intersection_volume_posed(const mv_prepared_mesh *first, const mv_prepared_mesh *second, const double *second_pose,
+                                       const mv_options *options, double *volume, double *error_estimate) {
+    if (!first || !second || !second_pose || !volume)
+        return fail(MV_INVALID_ARGUMENT, "Null argument.");
+
+    mesh::options opts;
+    if (!convert_options(options, opts))
+        return fail(MV_INVALID_ARGUMENT, "Invalid options.");
+
+    mymat4 pose;
+    for (int i = 0; i < 16; ++i)
+        pose[i % 4][i / 4] = (myfloat) second_pose[i];
+    if (!mesh::is_rigid(pose))
+        return fail(MV_INVALID_ARGUMENT, "The pose is not a rigid transformation.");
+
+    return guarded([&]{
+        mesh::engine_report report;
+        *volume = mesh::intersection_volume(first->prepared, second->prepared, pose, opts, &report);
+        if (error_estimate)
+            *error_estimate = report.error_estimate;
+        return MV_OK;
+    });
+}
+
+}
@@ -0,0 +1,666 @@
+
+#include "classify.h"
+#include "evaluation.h"
+#include "grid.h"
+#include "mesh.h"
+#include "multi.h"
+#include "reduction.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+
+namespace mesh {
+
+    // the meshes are perturbed by multiples of the same infinitesimal in their order, mesh k is translated by
+    // k * (e, e^2, e^3). every pair of meshes resolves degenerate configurations like the first and second mesh of a
+    // pairwise query, the pairwise predicates only see the sign of the difference of both indices
+    eval::perturbation perturbation_between(std::size_t lines, std::size_t triangles) {
+        return lines < triangles ? eval::lines_of_first_mesh : eval::lines_of_second_mesh;
+    }
+
+    // where the faces of three meshes meet, or two crossings of a side lie close together, the magnitudes of the
+    // translations matter. the exact values are polynomials in e then, whose lowest nonzero coefficient decides the
+    // sign. they are evaluated on the host only where the rounded values cannot decide
+
+    // nonoverlapping components in increasing magnitude, zero components are dropped (see eval::expansion)
+    using exact_value = std::vector<myfloat>;
+
+    int exact_sign(const exact_value &e) {
+        return e.empty() ? 0 : e.back() > 0 ? 1 : -1;
+    }
+
+    exact_value exact_sum(const exact_value &e, const exact_value &f, myfloat sign = 1) {
+        exact_value result(e);
+        result.reserve(e.size() + f.size());
+        for (myfloat component : f) {
+            myfloat q = sign * component;
+            std::size_t size = 0;
+            for (std::size_t i = 0; i < result.size(); ++i) {
+                myfloat sum, error;
+                eval::two_sum(q, result[i], sum, error);
+                q = sum;
+                if (error != 0)
+                    result[size++] = error;
+            }
+            result.resize(size);
+            if (q != 0)
+                result.push_back(q);
+        }
+        return result;
+    }
+
+    exact_value exact_product(const exact_value &e, const exact_value &f) {
+        exact_value result, scaled;
+        for (myfloat b : f) {
+            scaled.clear();
+            scaled.reserve(2 * e.size());
+            myfloat q = 0;
+            for (myfloat component : e) {
+                myfloat product, product_error, sum, error;
+                eval::two_product(component, b, product, product_error);
+                eval::two_sum(q, product_error, sum, error);
+                if (error != 0)
+                    scaled.push_back(error);
+                eval::two_sum(product, sum, q, error);
+                if (error != 0)
+                    scaled.push_back(error);
+            }
+            if (q != 0)
+                scaled.push_back(q);
+            result = exact_sum(result, scaled);
+        }
+        return result;
+    }
+
+    // coefficients of increasing powers of e
+    struct perturbed_value {
+        std::vector<exact_value> coefficients;
+    };
+
+    using perturbed_vec = std::array<perturbed_value, 3>;
+
+    perturbed_value constant(myfloat value) {
+        perturbed_value result;
+        result.coefficients.emplace_back();
+        if (value != 0)
+            result.coefficients[0].push_back(value);
+        return result;
+    }
+
+    int sign(const perturbed_value &v) {
+        for (const exact_value &coefficient : v.coefficients)
+            if (!coefficient.empty())
+                return exact_sign(coefficient);
+        return 0;
+    }
+
+    perturbed_value sum(const perturbed_value &v, const perturbed_value &w, myfloat sign = 1) {
+        perturbed_value result;
+        result.coefficients.resize(std::max(v.coefficients.size(), w.coefficients.size()));
+        for (std::size_t i = 0; i < result.coefficients.size(); ++i)
+            result.coefficients[i] = exact_sum(i < v.coefficients.size() ? v.coefficients[i] : exact_value(),
+                                               i < w.coefficients.size() ? w.coefficients[i] : exact_value(), sign);
+        return result;
+    }
+
+    perturbed_value difference(const perturbed_value &v, const perturbed_value &w) {
+        return sum(v, w, -1);
+    }
+
+    perturbed_value product(const perturbed_value &v, const perturbed_value &w) {
+        perturbed_value result;
+        if (v.coefficients.empty() || w.coefficients.empty())
+            return result;
+        result.coefficients.resize(v.coefficients.size() + w.coefficients.size() - 1);
+        for (std::size_t i = 0; i < v.coefficients.size(); ++i)
+            for (std::size_t j = 0; j < w.coefficients.size(); ++j)
+                if (!v.coefficients[i].empty() && !w.coefficients[j].empty())
+                    result.coefficients[i + j] = exact_sum(result.coefficients[i + j], exact_product(v.coefficients[i], w.coefficients[j]));
+        return result;
+    }
+
+    perturbed_vec difference(const perturbed_vec &v, const perturbed_vec &w) {
+        return {difference(v[0], w[0]), difference(v[1], w[1]), difference(v[2], w[2])};
+    }
+
+    perturbed_vec scaled(const perturbed_value &s, const perturbed_vec &v) {
+        return {product(s, v[0]), product(s, v[1]), product(s, v[2])};
+    }
+
+    perturbed_value dot(const perturbed_vec &v, const perturbed_vec &w) {
+        return sum(sum(product(v[0], w[0]), product(v[1], w[1])), product(v[2], w[2]));
+    }
+
+    perturbed_vec cross(const perturbed_vec &v, const perturbed_vec &w) {
+        return {difference(product(v[1], w[2]), product(v[2], w[1])),
+                difference(product(v[2], w[0]), product(v[0], w[2])),
+                difference(product(v[0], w[1]), product(v[1], w[0]))};
+    }
+
+    // a vertex of mesh k, component i is translated by k * e^(i + 1)
+    perturbed_vec perturbed_point(const myvec &p, std::size_t mesh) {
+        perturbed_vec result;
+        for (int i = 0; i < 3; ++i) {
+            result[i].coefficients.resize(i + 2);
+            if (p[i] != 0)
+                result[i].coefficients[0].push_back(p[i]);
+            if (mesh != 0)
+                result[i].coefficients[i + 1].push_back(myfloat(mesh));
+        }
+        return result;
+    }
+
+    // the plane of a triangle of mesh k, dot(normal, x) == offset
+    struct perturbed_plane {
+        perturbed_vec normal;
+        perturbed_value offset;
+
+        perturbed_plane(const ntriangle &t, std::size_t mesh) {
+            perturbed_vec a = perturbed_point(t.a, mesh);
+            normal = cross(difference(perturbed_point(t.b, mesh), a), difference(perturbed_point(t.c, mesh), a));
+            offset = dot(normal, a);
+        }
+    };
+
+    enum class combination {
+        intersection,
+        union_all
+    };
+
+    struct multi_mesh {
+        std::vector<ntriangle> triangles;
+        myvec min, max;
+    };
+
+    struct multi_crossing {
+        myfloat scalar, error;
+        std::size_t mesh;
+        const ntriangle *triangle;
+    };
+
+    // sign of the position of the first crossing along a side of mesh k minus that of the second. the side crosses
+    // the plane of a triangle at -dot(n, start - a) / dot(n, end - start)
+    int compare_crossings(const line &side, std::size_t mesh, const multi_crossing &first, const multi_crossing &second) {
+        perturbed_vec start = perturbed_point(side.start, mesh);
+        perturbed_vec direction = difference(perturbed_point(side.end, mesh), start);
+        perturbed_value distance[2], speed[2];
+        for (int i = 0; i < 2; ++i) {
+            const multi_crossing &c = i == 0 ? first : second;
+            perturbed_plane plane(*c.triangle, c.mesh);
+            distance[i] = difference(dot(plane.normal, start), plane.offset);
+            speed[i] = dot(plane.normal, direction);
+        }
+        return sign(difference(product(distance[1], speed[0]), product(distance[0], speed[1]))) * sign(speed[0]) * sign(speed[1]);
+    }
+
+    // orders the crossings along a side by their rounded positions where their error bounds do not overlap, exactly
+    // otherwise. crossings of the same mesh at the same position are ordered by their triangles
+    bool precedes(const line &side, std::size_t mesh, const multi_crossing &first, const multi_crossing &second) {
+        if (first.scalar + first.error < second.scalar - second.error)
+            return true;
+        if (second.scalar + second.error < first.scalar - first.error)
+            return false;
+        int order = compare_crossings(side, mesh, first, second);
+        return order != 0 ? order < 0 : first.triangle < second.triangle;
+    }
+
+    // abs_cross(|u|, |v|) bounds the components of cross(u, v)
+    myvec abs_cross(const myvec &u, const myvec &v) {
+        return myvec(u.y * v.z + u.z * v.y, u.z * v.x + u.x * v.z, u.x * v.y + u.y * v.x);
+    }
+
+    // side of the line where the planes of the first two faces meet relative to the edge (a, b) of the third, the
+    // Pluecker product of both lines. the rounded value relative to a vertex of the first face decides unless it lies
+    // within its error bound
+    int meeting_line_side(const ntriangle *const faces[3], const std::size_t meshes[3], const myvec &a, const myvec &b) {
+        const myvec &origin = faces[0]->a;
+        myvec normal[2], abs_normal[2];
+        myfloat offset[2], abs_offset[2];
+        for (int i = 0; i < 2; ++i) {
+            const ntriangle &t = *faces[i];
+            myvec u = t.b - t.a, v = t.c - t.a;
+            normal[i] = glm::cross(u, v);
+            abs_normal[i] = abs_cross(glm::abs(u), glm::abs(v));
+            offset[i] = glm::dot(normal[i], t.a - origin);
+            abs_offset[i] = glm::dot(abs_normal[i], glm::abs(t.a - origin));
+        }
+        myvec direction = glm::cross(normal[0], normal[1]);
+        myvec moment = offset[1] * normal[0] - offset[0] * normal[1];
+        myvec first = a - origin, second = b - origin;
+        myfloat value = glm::dot(direction, glm::cross(first, second)) + glm::dot(second - first, moment);
+
+        myvec abs_direction = abs_cross(abs_normal[0], abs_normal[1]);
+        myvec abs_moment = abs_offset[1] * abs_normal[0] + abs_offset[0] * abs_normal[1];
+        myfloat bound = 32 * std::numeric_limits<myfloat>::epsilon()
+                        * (glm::dot(abs_direction, abs_cross(glm::abs(first), glm::abs(second)))
+                           + glm::dot(glm::abs(first) + glm::abs(second), abs_moment));
+        if (value > bound || value < -bound)
+            return value > 0 ? 1 : -1;
+
+        // the value is linear in the translations. an endpoint on both planes, a vertex shared by all three faces,
+        // lies on the line, only the perturbation decides then
+        perturbed_vec exact_first = perturbed_point(a, 0), exact_second = perturbed_point(b, 0);
+        auto on_plane = [](const ntriangle &t, const myvec &p) { return t.a == p || t.b == p || t.c == p; };
+        if (!(on_plane(*faces[0], a) && on_plane(*faces[1], a)) && !(on_plane(*faces[0], b) && on_plane(*faces[1], b))) {
+            perturbed_plane planes[2] = {perturbed_plane(*faces[0], 0), perturbed_plane(*faces[1], 0)};
+            perturbed_vec exact_direction = cross(planes[0].normal, planes[1].normal);
+            perturbed_vec exact_moment = difference(scaled(planes[1].offset, planes[0].normal), scaled(planes[0].offset, planes[1].normal));
+            int value_sign = sign(sum(dot(exact_direction, cross(exact_first, exact_second)), dot(difference(exact_second, exact_first), exact_moment)));
+            if (value_sign != 0)
+                return value_sign;
+        }
+
+        // the coefficients of (e, e^2, e^3) are the components of
+        // k cross(b - a, direction) + j dot(b - a, normal_0) normal_1 - i dot(b - a, normal_1) normal_0
+        const myfloat i = myfloat(meshes[0]), j = myfloat(meshes[1]), k = myfloat(meshes[2]);
+        myvec edge = b - a, abs_edge = glm::abs(edge);
+        myvec coefficients = k * glm::cross(edge, direction) + j * glm::dot(edge, normal[0]) * normal[1] - i * glm::dot(edge, normal[1]) * normal[0];
+        myvec bounds = 32 * std::numeric_limits<myfloat>::epsilon()
+                       * (k * abs_cross(abs_edge, abs_direction) + j * glm::dot(abs_edge, abs_normal[0]) * abs_normal[1]
+                          + i * glm::dot(abs_edge, abs_normal[1]) * abs_normal[0]);
+        for (int axis = 0; axis < 3; ++axis) {
+            if (coefficients[axis] > bounds[axis] || coefficients[axis] < -bounds[axis])
+                return coefficients[axis] > 0 ? 1 : -1;
+
+            perturbed_plane planes[2] = {perturbed_plane(*faces[0], 0), perturbed_plane(*faces[1], 0)};
+            perturbed_vec exact_edge = difference(exact_second, exact_first);
+            perturbed_value projections[2] = {dot(exact_edge, planes[0].normal), dot(exact_edge, planes[1].normal)};
+            perturbed_vec rotation = cross(exact_edge, cross(planes[0].normal, planes[1].normal));
+            int coefficient_sign = sign(sum(sum(product(constant(k), rotation[axis]), product(product(constant(j), projections[0]), planes[1].normal[axis])),
+                                            product(product(constant(i), projections[1]), planes[0].normal[axis]), -1));
+            if (coefficient_sign != 0)
+                return coefficient_sign;
+        }
+        return 0;
+    }
+
+    // does the line where the planes of the first two faces meet pass through the third face
+    bool meets_inside(const ntriangle *const faces[3], const std::size_t meshes[3]) {
+        const ntriangle &t = *faces[2];
+        int orientation = meeting_line_side(faces, meshes, t.a, t.b);
+        return orientation != 0 && meeting_line_side(faces, meshes, t.b, t.c) == orientation
+               && meeting_line_side(faces, meshes, t.c, t.a) == orientation;
+    }
+
+    // the point where the planes of three faces meet is numerator / denominator
+    struct meeting_point {
+        perturbed_vec numerator;
+        perturbed_value denominator;
+
+        meeting_point(const ntriangle *const faces[3], const std::size_t meshes[3]) {
+            perturbed_plane planes[3] = {perturbed_plane(*faces[0], meshes[0]), perturbed_plane(*faces[1], meshes[1]),
+                                         perturbed_plane(*faces[2], meshes[2])};
+            numerator = {};
+            for (int i = 0; i < 3; ++i) {
+                perturbed_vec term = scaled(planes[i].offset, cross(planes[(i + 1) % 3].normal, planes[(i + 2) % 3].normal));
+                for (int axis = 0; axis < 3; ++axis)
+                    numerator[axis] = sum(numerator[axis], term[axis]);
+            }
+            denominator = dot(planes[0].normal, cross(planes[1].normal, planes[2].normal));
+        }
+    };
+
+    // does the ray from the point along +z cross a face of mesh k, like crosses_above of the classifiers. the point
+    // lies inside the projection of the face if the vertical line through it passes all edges on the same side
+    bool crosses_above(const meeting_point &point, const ntriangle &t, std::size_t mesh) {
+        perturbed_vec vertices[3] = {perturbed_point(t.a, mesh), perturbed_point(t.b, mesh), perturbed_point(t.c, mesh)};
+        int orientation = 0;
+        for (int i = 0; i < 3; ++i) {
+            const perturbed_vec &a = vertices[i], &b = vertices[(i + 1) % 3];
+            perturbed_vec edge = difference(b, a);
+            int side = sign(sum(product(point.denominator, cross(a, b)[2]),
+                                difference(product(edge[0], point.numerator[1]), product(edge[1], point.numerator[0]))));
+            if (side == 0 || (orientation != 0 && side != orientation))
+                return false;
+            orientation = side;
+        }
+
+        perturbed_vec normal = cross(difference(vertices[1], vertices[0]), difference(vertices[2], vertices[0]));
+        perturbed_value distance = difference(dot(normal, point.numerator), product(point.denominator, dot(normal, vertices[0])));
+        return sign(distance) * sign(point.denominator) * sign(normal[2]) < 0;
+    }
+
+    // a triangle of another mesh near the triangle being evaluated
+    struct multi_candidate {
+        std::size_t mesh;
+        const ntriangle *triangle;
+    };
+
+    // a vertex of the intersection lies inside all other meshes. a vertex of the union lies outside all other
+    // meshes, there the union of the half-spaces is the complement of the intersection of their complements. the
+    // complement has the same edges and faces with flipped normals and sides, so every term of the union is the
+    // negated term of the complement, which the intersection terms already describe
+    class multi_evaluation {
+    public:
+        multi_evaluation(const std::vector<const prepared_mesh *> &meshes, combination operation) : operation(operation) {
+            myvec overlap_min(-std::numeric_limits<myfloat>::infinity()), overlap_max(std::numeric_limits<myfloat>::infinity());
+            for (const prepared_mesh *mesh : meshes) {
+                overlap_min = glm::max(overlap_min, mesh->min);
+                overlap_max = glm::min(overlap_max, mesh->max);
+            }
+            disjoint = operation == combination::intersection && glm::any(glm::lessThan(overlap_max, overlap_min));
+            if (disjoint)
+                return;
+
+            // the grid over the members only looks at the bounding boxes of its triangles, so each member is a
+            // triangle spanning its own box
+            std::vector<ntriangle> boxes;
+            for (const prepared_mesh *mesh : meshes)
+                boxes.emplace_back(mesh->min, mesh->max, mesh->min, myvec(0));
+            // the intersection lies within the overlap of all boxes, the members of a union overlap each other (see
+            // union_volume), so the origin stays close to every contact
+            std::vector<ntriangle> overlap{ntriangle(overlap_min, overlap_max, overlap_min, myvec(0))};
+            myvec origin = operation == combination::intersection ? local_origin(overlap, overlap) : local_origin(boxes, boxes);
+
+            staged.resize(meshes.size());
+            std::vector<ntriangle> all;
+            triangle_offsets.push_back(0);
+            for (std::size_t i = 0; i < meshes.size(); ++i) {
+                staged[i].triangles = convert_precision<myfloat>(meshes[i]->triangles, origin);
+                staged[i].min = meshes[i]->min - origin;
+                staged[i].max = meshes[i]->max - origin;
+                boxes[i] = ntriangle(staged[i].min, staged[i].max, staged[i].min, myvec(0));
+                all.insert(all.end(), staged[i].triangles.begin(), staged[i].triangles.end());
+                triangle_offsets.push_back(all.size());
+            }
+
+            // one index over the triangles of all meshes, a query costs the same for any number of members
+            grid.reset(new triangle_grid(all));
+            members.reset(new triangle_grid(boxes));
+
+            // the classifiers refer to the staged meshes, which do not move from here on
+            for (const auto &mesh : staged) {
+                below.emplace_back(new projected_classifier(mesh.triangles, eval::lines_of_first_mesh));
+                above.emplace_back(new projected_classifier(mesh.triangles, eval::lines_of_second_mesh));
+            }
+        }
+
+        // the terms of the complement are subtracted from the result
+        void evaluate(eval::compensated_sum<myfloat> &terms, eval::compensated_sum<myfloat> &complement_terms) const {
+            if (disjoint)
+                return;
+
+            const std::size_t count = triangle_offsets.back();
+            std::vector<eval::compensated_sum<myfloat>> complements((count + reduction_block_size - 1) / reduction_block_size);
+            terms.add(deterministic_reduce<myfloat>(count, [&](std::size_t first, std::size_t last) {
+                return evaluate_triangles(first, last, complements[first / reduction_block_size]);
+            }));
+            for (const auto &complement : complements)
+                complement_terms.add(complement);
+        }
+
+    private:
+        bool inside(std::size_t mesh, std::size_t of_mesh, const myvec &point) const {
+            return (mesh < of_mesh ? *below[of_mesh] : *above[of_mesh]).is_inside(point);
+        }
+
+        // visits every member other than mesh which contains a point of mesh
+        template <typename visitor_t>
+        void containing(std::size_t mesh, const myvec &point, visitor_t &&visit) const {
+            members->query(point, point, [&](std::size_t other) {
+                if (other != mesh && inside(mesh, other, point))
+                    visit(other);
+            });
+        }
+
+        // whether a point on the faces of the excluded meshes is a vertex of the result, given how many of the
+        // remaining meshes contain it
+        bool is_vertex(std::size_t containing_count, std::size_t excluded) const {
+            if (operation == combination::intersection)
+                return containing_count + excluded == staged.size();
+            return containing_count == 0;
+        }
+
+        // crossings with each other mesh are sorted along the side while the number of meshes containing the
+        // current point is tracked. the intersection segments of the triangle with later meshes are evaluated
+        // from the same candidates
+        eval::compensated_sum<myfloat> evaluate_triangles(std::size_t first, std::size_t last, eval::compensated_sum<myfloat> &complement) const {
+            eval::term_batch batch, complement_batch;
+            eval::compensated_sum<myfloat> accum;
+            std::vector<multi_candidate> candidates;
+            std::vector<multi_crossing> crossings;
+            std::vector<char> is_inside(staged.size());
+            std::vector<std::size_t> touched;
+
+            std::size_t mesh = std::upper_bound(triangle_offsets.begin(), triangle_offsets.end(), first) - triangle_offsets.begin() - 1;
+            for (std::size_t i = first; i < last; ++i) {
+                while (i >= triangle_offsets[mesh + 1])
+                    ++mesh;
+
+                const ntriangle &t = staged[mesh].triangles[i - triangle_offsets[mesh]];
+                candidates.clear();
+                grid->query(glm::min(t.a, glm::min(t.b, t.c)), glm::max(t.a, glm::max(t.b, t.c)), [&](std::size_t triangle) {
+                    std::size_t other = std::upper_bound(triangle_offsets.begin(), triangle_offsets.end(), triangle) - triangle_offsets.begin() - 1;
+                    if (other != mesh)
+                        candidates.push_back({other, &staged[other].triangles[triangle - triangle_offsets[other]]});
+                });
+
+                for (std::size_t k = 0; k < 3; ++k) {
+                    triangle_side side = extract_side(t, k);
+
+                    crossings.clear();
+                    for (const multi_candidate &c : candidates) {
+                        myfloat scalar;
+                        if (eval::find_crossing(*c.triangle, side, perturbation_between(mesh, c.mesh), scalar) == eval::crossing::on_segment)
+                            crossings.push_back({scalar, eval::crossing_error(*c.triangle, side), c.mesh, c.triangle});
+                    }
+
+                    std::size_t inside_count = 0;
+                    touched.clear();
+                    containing(mesh, side.start, [&](std::size_t other) {
+                        is_inside[other] = 1;
+                        touched.push_back(other);
+                        ++inside_count;
+                    });
+
+                    // a side without crossings keeps its state, and contributes only if its start does
+                    if (is_vertex(inside_count, 1) || !crossings.empty()) {
+                        std::sort(crossings.begin(), crossings.end(), [&](const multi_crossing &first, const multi_crossing &second) {
+                            return precedes(side, mesh, first, second);
+                        });
+                        const bool start_vertex = is_vertex(inside_count, 1);
+                        for (const multi_crossing &c : crossings) {
+                            if (is_vertex(inside_count - is_inside[c.mesh], 2)) {
+                                myvec intersection_point = (1 - c.scalar) * side.start + c.scalar * side.end;
+                                eval::term_batch &target = operation == combination::intersection ? batch : complement_batch;
+                                if (target.full())
+                                    target.flush(operation == combination::intersection ? accum : complement);
+                                if (operation == combination::intersection)
+                                    target.push(intersection_point, side.end - side.start, side.n, c.triangle->n);
+                                else
+                                    target.push(intersection_point, side.start - side.end, -side.n, -c.triangle->n);
+                            }
+                            is_inside[c.mesh] = !is_inside[c.mesh];
+                            if (is_inside[c.mesh]) {
+                                touched.push_back(c.mesh);
+                                ++inside_count;
+                            } else {
+                                --inside_count;
+                            }
+                        }
+                        accum.add(eval::evaluate_line_intersection(side, start_vertex, is_vertex(inside_count, 1)));
+                    }
+
+                    for (std::size_t other : touched)
+                        is_inside[other] = 0;
+                }
+
+                triple_terms(mesh, t, candidates, accum, complement);
+            }
+
+            batch.flush(accum);
+            complement_batch.flush(complement);
+            return accum;
+        }
+
+        // the intersection segment of a triangle and one of a later mesh is bounded by the two crossings of their
+        // sides, it meets the faces of every even later mesh in the points where three surfaces meet. the point lies
+        // in all three faces if the line where any two of their planes meet passes through the third
+        void triple_terms(std::size_t i, const ntriangle &t, const std::vector<multi_candidate> &candidates,
+                          eval::compensated_sum<myfloat> &accum, eval::compensated_sum<myfloat> &complement) const {
+            for (const multi_candidate &c : candidates) {
+                if (c.mesh < i)
+                    continue;
+
+                const std::size_t j = c.mesh;
+                const ntriangle &u = *c.triangle;
+                myvec ends[2], spread(0);
+                int found = 0;
+                for (std::size_t k = 0; k < 6 && found < 3; ++k) {
+                    triangle_side side = extract_side(k < 3 ? t : u, k % 3);
+                    myfloat scalar;
+                    if (eval::find_crossing(k < 3 ? u : t, side, k < 3 ? perturbation_between(i, j) : perturbation_between(j, i),
+                                            scalar) == eval::crossing::on_segment) {
+                        if (found < 2) {
+                            ends[found] = (1 - scalar) * side.start + scalar * side.end;
+                            // bound on the distance of the rounded end from the exact one
+                            myfloat error = eval::crossing_error(k < 3 ? u : t, side);
+                            spread = glm::max(spread, error < std::numeric_limits<myfloat>::infinity()
+                                                      ? error * glm::abs(side.end - side.start)
+                                                        + 4 * std::numeric_limits<myfloat>::epsilon() * (glm::abs(side.start) + glm::abs(side.end))
+                                                      : myvec(std::numeric_limits<myfloat>::infinity()));
+                        }
+                        ++found;
+                    }
+                }
+                // only a proper crossing of the two triangles has a segment
+                if (found != 2)
+                    continue;
+
+                // the boxes of both triangles contain the exact segment as well
+                myvec min = glm::max(glm::min(ends[0], ends[1]) - spread, glm::max(triangle_min(t), triangle_min(u)));
+                myvec max = glm::min(glm::max(ends[0], ends[1]) + spread, glm::min(triangle_max(t), triangle_max(u)));
+                grid->query(min, max, [&](std::size_t h) {
+                    if (h < triangle_offsets[j + 1])
+                        return;
+                    const std::size_t k = std::upper_bound(triangle_offsets.begin(), triangle_offsets.end(), h) - triangle_offsets.begin() - 1;
+                    const ntriangle &v = staged[k].triangles[h - triangle_offsets[k]];
+
+                    const ntriangle *faces[3] = {&t, &u, &v}, *rotated[3] = {&u, &v, &t}, *other_rotated[3] = {&v, &t, &u};
+                    const std::size_t meshes[3] = {i, j, k}, rotated_meshes[3] = {j, k, i}, other_rotated_meshes[3] = {k, i, j};
+                    if (!meets_inside(faces, meshes) || !meets_inside(rotated, rotated_meshes) || !meets_inside(other_rotated, other_rotated_meshes))
+                        return;
+
+                    std::size_t inside_count = 0;
+                    if (staged.size() > 3)
+                        inside_count = containing_count(faces, meshes);
+                    if (!is_vertex(inside_count, 3))
+                        return;
+
+                    // the rounded point lies on the rounded segment
+                    myvec n = glm::cross(v.b - v.a, v.c - v.a);
+                    myfloat start_distance = glm::dot(n, ends[0] - v.a), end_distance = glm::dot(n, ends[1] - v.a);
+                    myfloat scalar = start_distance != end_distance ? glm::clamp(start_distance / (start_distance - end_distance), myfloat(0), myfloat(1))
+                                                                    : myfloat(0.5);
+                    myvec point = (1 - scalar) * ends[0] + scalar * ends[1];
+                    if (operation == combination::intersection)
+                        accum.add(eval::generate_triple_terms(point, t.n, u.n, v.n));
+                    else
+                        complement.add(eval::generate_triple_terms(point, -t.n, -u.n, -v.n));
+                });
+            }
+        }
+
+        // how many meshes other than those of the faces contain the point where the faces meet, the exact point casts
+        // its ray through the faces of each mesh whose box may contain it
+        std::size_t containing_count(const ntriangle *const faces[3], const std::size_t meshes[3]) const {
+            myvec min = glm::max(triangle_min(*faces[0]), glm::max(triangle_min(*faces[1]), triangle_min(*faces[2])));
+            myvec max = glm::min(triangle_max(*faces[0]), glm::min(triangle_max(*faces[1]), triangle_max(*faces[2])));
+            std::unique_ptr<meeting_point> point;
+            std::size_t count = 0;
+            members->query(min, max, [&](std::size_t other) {
+                if (other == meshes[0] || other == meshes[1] || other == meshes[2])
+                    return;
+                if (!point)
+                    point.reset(new meeting_point(faces, meshes));
+
+                std::size_t crossings = 0;
+                grid->query(min, myvec(max.x, max.y, std::max(max.z, staged[other].max.z)), [&](std::size_t h) {
+                    if (h >= triangle_offsets[other] && h < triangle_offsets[other + 1])
+                        crossings += crosses_above(*point, staged[other].triangles[h - triangle_offsets[other]], other);
+                });
+                count += crossings % 2;
+            });
+            return count;
+        }
+
+        combination operation;
+        bool disjoint = false;
+        std::vector<multi_mesh> staged;
+        // over the triangles of all meshes and over the bounding boxes of the meshes
+        std::unique_ptr<triangle_grid> grid, members;
+        // classify points of earlier and of later meshes
+        std::vector<std::unique_ptr<projected_classifier>> below, above;
+        // triangles of mesh i are [triangle_offsets[i], triangle_offsets[i + 1]) of all triangles
+        std::vector<std::size_t> triangle_offsets;
+    };
+
+    myfloat combined_volume(const std::vector<const prepared_mesh *> &meshes, combination operation, myfloat *error_estimate) {
+        eval::compensated_sum<myfloat> terms, complement_terms;
+        multi_evaluation(meshes, operation).evaluate(terms, complement_terms);
+        if (error_estimate)
+            *error_estimate = (terms.error_estimate() + complement_terms.error_estimate()) / 6;
+        return (terms.value() - complement_terms.value()) / 6;
+    }
+
+    myfloat intersection_volume(const std::vector<const prepared_mesh *> &meshes, myfloat *error_estimate) {
+        if (error_estimate)
+            *error_estimate = 0;
+        if (meshes.empty())
+            return 0;
+        if (meshes.size() == 1)
+            return meshes[0]->volume;
+
+        return combined_volume(meshes, combination::intersection, error_estimate);
+    }
+
+    // groups of the meshes whose boxes overlap, directly or through other meshes, each in the given order
+    std::vector<std::vector<const prepared_mesh *>> overlapping_groups(const std::vector<const prepared_mesh *> &meshes) {
+        std::vector<std::size_t> parent(meshes.size());
+        for (std::size_t i = 0; i < meshes.size(); ++i)
+            parent[i] = i;
+        auto root = [&](std::size_t i) {
+            while (parent[i] != i)
+                i = parent[i];
+            return i;
+        };
+        for (std::size_t i = 0; i < meshes.size(); ++i)
+            for (std::size_t j = i + 1; j < meshes.size(); ++j)
+                if (!glm::any(glm::greaterThan(meshes[i]->min, meshes[j]->max)) && !glm::any(glm::greaterThan(meshes[j]->min, meshes[i]->max)))
+                    parent[root(j)] = root(i);
+
+        std::vector<std::vector<const prepared_mesh *>> groups;
+        std::vector<std::size_t> group_of(meshes.size(), meshes.size());
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+            std::size_t &group = group_of[root(i)];
+            if (group == meshes.size()) {
+                group = groups.size();
+                groups.emplace_back();
+            }
+            groups[group].push_back(meshes[i]);
+        }
+        return groups;
+    }
+
+    myfloat union_volume(const std::vector<const prepared_mesh *> &meshes, myfloat *error_estimate) {
+        if (error_estimate)
+            *error_estimate = 0;
+
+        // empty meshes have no bounding box
+        std::vector<const prepared_mesh *> members;
+        for (const prepared_mesh *mesh : meshes)
+            if (!mesh->triangles.empty())
+                members.push_back(mesh);
+        // groups without overlapping boxes do not touch, each is evaluated relative to an origin within its own boxes
+        myfloat volume = 0;
+        for (const auto &group : overlapping_groups(members)) {
+            myfloat group_error = 0;
+            volume += group.size() == 1 ? group[0]->volume : combined_volume(group, combination::union_all, &group_error);
+            if (error_estimate)
+                *error_estimate += group_error;
+        }
+        return volume;
+    }
+}
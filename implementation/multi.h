@@ -0,0 +1,26 @@
+#ifndef MI_MULTI_H
+#define MI_MULTI_H
+
+#include "engine.h"
+#include "globals.h"
+
+#include <vector>
+
+namespace mesh {
+
+    // volume of the intersection of all meshes in one pass. every side tracks its parity against each other mesh, so
+    // its crossings and endpoints only generate terms where they lie inside all remaining meshes. points where the
+    // faces of three meshes meet are found on the intersection segments of the triangle pairs. all decisions are exact,
+    // mesh k is perturbed by k times the same infinitesimal, so the volume does not depend on the order of the meshes.
+    // for two meshes this is the pipelined engine in myfloat
+    myfloat intersection_volume(const std::vector<const prepared_mesh *> &meshes, myfloat *error_estimate = nullptr);
+
+    // volume of the union of all meshes in one pass, without inclusion-exclusion. every fragment of a boundary
+    // outside all other meshes is a part of the boundary of the union, so the same terms as for the intersection
+    // are generated where a point lies inside none of the remaining meshes. the meshes share one grid over their
+    // triangles and one over their bounding boxes, the cost grows with the triangles and the contacts between them.
+    // groups of meshes whose boxes do not overlap are evaluated separately, each relative to its own origin
+    myfloat union_volume(const std::vector<const prepared_mesh *> &meshes, myfloat *error_estimate = nullptr);
+}
+
+#endif
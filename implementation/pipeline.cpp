@@ -0,0 +1,428 @@
+
+#include "classify.h"
+#include "evaluation.h"
+#include "grid.h"
+#include "mesh.h"
+#include "pipeline.h"
+#include "reduction.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace mesh {
+
+    using pipeline_clock = std::chrono::steady_clock;
+
+    double seconds_since(pipeline_clock::time_point start) {
+        return std::chrono::duration<double>(pipeline_clock::now() - start).count();
+    }
+
+    int thread_count() {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    int thread_id() {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return 0;
+#endif
+    }
+
+    // side index (3 * triangle + side) and triangle index of a pair which passed the broadphase
+    struct candidate {
+        std::uint32_t side;
+        std::uint32_t triangle;
+    };
+
+    // triangle of the first and triangle of the second mesh with overlapping bounding boxes
+    struct triangle_pair {
+        std::uint32_t first;
+        std::uint32_t second;
+    };
+
+    constexpr std::size_t candidate_chunk_size = 4096;
+
+    // per-thread candidate storage, grows in fixed-size chunks so emitting never moves existing candidates
+    template <typename candidate_t>
+    struct chunked_buffer {
+        std::vector<std::vector<candidate_t>> chunks;
+
+        void push(const candidate_t &c) {
+            if (chunks.empty() || chunks.back().size() == candidate_chunk_size) {
+                chunks.emplace_back();
+                chunks.back().reserve(candidate_chunk_size);
+            }
+            chunks.back().push_back(c);
+        }
+    };
+
+    using candidate_buffer = chunked_buffer<candidate>;
+    using pair_buffer = chunked_buffer<triangle_pair>;
+
+    void broadphase(const triangle_grid &grid, const std::vector<ntriangle> &lines, std::vector<candidate_buffer> &buffers) {
+        buffers.assign(thread_count(), candidate_buffer{});
+
+        // static scheduling hands out contiguous ranges in thread order, so the buffers hold the candidates in side order
+        // for any thread count, which keeps the narrowphase sums reproducible
+        #pragma omp parallel for schedule(static)
+        for (std::int64_t i = 0; std::size_t(i) < lines.size() * 3; ++i) {
+            const triangle_side side = extract_side(lines[i / 3], (std::size_t) i % 3);
+            candidate_buffer &buffer = buffers[thread_id()];
+
+            grid.query(glm::min(side.start, side.end), glm::max(side.start, side.end), [&](std::size_t triangle) {
+                buffer.push({(std::uint32_t) i, (std::uint32_t) triangle});
+            });
+        }
+    }
+
+    void pair_broadphase(const triangle_grid &grid, const std::vector<ntriangle> &first_mesh, std::vector<pair_buffer> &buffers) {
+        buffers.assign(thread_count(), pair_buffer{});
+
+        #pragma omp parallel for schedule(static)
+        for (std::int64_t i = 0; std::size_t(i) < first_mesh.size(); ++i) {
+            const ntriangle &t = first_mesh[i];
+            pair_buffer &buffer = buffers[thread_id()];
+
+            grid.query(glm::min(t.a, glm::min(t.b, t.c)), glm::max(t.a, glm::max(t.b, t.c)), [&](std::size_t triangle) {
+                buffer.push({(std::uint32_t) i, (std::uint32_t) triangle});
+            });
+        }
+    }
+
+    // counting sort by triangle, so consecutive candidates share the same triangle data
+    void sort_by_triangle(const std::vector<candidate_buffer> &buffers, std::size_t triangle_count, std::vector<candidate> &sorted) {
+        std::vector<std::size_t> offsets(triangle_count + 1, 0);
+        for (const auto &buffer : buffers)
+            for (const auto &chunk : buffer.chunks)
+                for (const auto &c : chunk)
+                    offsets[c.triangle + 1] += 1;
+
+        for (std::size_t i = 1; i < offsets.size(); ++i)
+            offsets[i] += offsets[i - 1];
+
+        sorted.resize(offsets.back());
+        for (const auto &buffer : buffers)
+            for (const auto &chunk : buffer.chunks)
+                for (const auto &c : chunk)
+                    sorted[offsets[c.triangle]++] = c;
+    }
+
+    template <typename float_t>
+    std::vector<basic_ntriangle<float_t>> subset(const std::vector<basic_ntriangle<float_t>> &mesh, const std::vector<std::size_t> &indices) {
+        std::vector<basic_ntriangle<float_t>> result;
+        result.reserve(indices.size());
+        for (std::size_t i : indices)
+            result.push_back(mesh[i]);
+        return result;
+    }
+
+    // a mesh relative to the local origin in the precision of the term evaluation, with a lower precision copy to filter candidate pairs if they differ
+    template <typename test_t, typename eval_t>
+    struct staged_mesh {
+        std::vector<basic_ntriangle<eval_t>> triangles;
+        std::vector<basic_ntriangle<test_t>> filter;
+
+        staged_mesh(const std::vector<ntriangle> &mesh, const myvec &origin)
+                : triangles(convert_precision<eval_t>(mesh, origin)), filter(convert_precision<test_t>(mesh, origin)) {}
+        staged_mesh(const staged_mesh &whole, const std::vector<std::size_t> &indices)
+                : triangles(subset(whole.triangles, indices)), filter(subset(whole.filter, indices)) {}
+    };
+
+    template <typename float_t>
+    struct staged_mesh<float_t, float_t> {
+        std::vector<basic_ntriangle<float_t>> triangles;
+
+        staged_mesh(const std::vector<ntriangle> &mesh, const myvec &origin) : triangles(convert_precision<float_t>(mesh, origin)) {}
+        staged_mesh(const staged_mesh &whole, const std::vector<std::size_t> &indices) : triangles(subset(whole.triangles, indices)) {}
+    };
+
+    // tests a side against a triangle, hits flip the side's parity and are gathered for evaluation
+    template <typename float_t>
+    inline bool test_side(const basic_ntriangle<float_t> &t, const basic_triangle_side<float_t> &side, eval::perturbation p,
+                          unsigned char &parity, eval::basic_term_batch<float_t> &batch, eval::compensated_sum<float_t> &accum) {
+        float_t scalar;
+        if (eval::find_crossing(t, side, p, scalar) != eval::crossing::on_segment)
+            return false;
+
+        #pragma omp atomic
+        parity ^= 1;
+
+        if (batch.full())
+            batch.flush(accum);
+        batch.push((1 - scalar) * side.start + scalar * side.end, side.end - side.start, side.n, t.n);
+        return true;
+    }
+
+    template <typename float_t>
+    inline bool test_side(const staged_mesh<float_t, float_t> &triangles, std::size_t triangle,
+                          const staged_mesh<float_t, float_t> &lines, std::size_t side, eval::perturbation p,
+                          unsigned char &parity, eval::basic_term_batch<float_t> &batch, eval::compensated_sum<float_t> &accum) {
+        return test_side(triangles.triangles[triangle], extract_side(lines.triangles[side / 3], side % 3), p, parity, batch, accum);
+    }
+
+    // pairs which the filter cannot reject with certainty are tested again in the evaluation precision
+    template <typename test_t, typename eval_t>
+    inline bool test_side(const staged_mesh<test_t, eval_t> &triangles, std::size_t triangle,
+                          const staged_mesh<test_t, eval_t> &lines, std::size_t side, eval::perturbation p,
+                          unsigned char &parity, eval::basic_term_batch<eval_t> &batch, eval::compensated_sum<eval_t> &accum) {
+        const basic_ntriangle<test_t> &filter = triangles.filter[triangle];
+        const basic_triangle_side<test_t> filter_side = extract_side(lines.filter[side / 3], side % 3);
+        if (eval::certainly_misses(filter.a, filter.b, filter.c, filter_side.start, filter_side.end - filter_side.start))
+            return false;
+
+        return test_side(triangles.triangles[triangle], extract_side(lines.triangles[side / 3], side % 3), p, parity, batch, accum);
+    }
+
+    template <typename test_t, typename eval_t>
+    eval::compensated_sum<eval_t> narrowphase(const staged_mesh<test_t, eval_t> &triangles, const staged_mesh<test_t, eval_t> &lines, eval::perturbation p,
+                       const std::vector<candidate> &candidates, std::vector<unsigned char> &parity, std::size_t &hits) {
+        std::size_t hit_count = 0;
+
+        eval::compensated_sum<eval_t> accum = deterministic_reduce<eval_t>(candidates.size(), [&](std::size_t first, std::size_t last) {
+            // hits are gathered per block and their terms evaluated in batches
+            eval::basic_term_batch<eval_t> batch;
+            eval::compensated_sum<eval_t> block_accum;
+            std::size_t block_hits = 0;
+
+            for (std::size_t i = first; i < last; ++i) {
+                const candidate &c = candidates[i];
+                block_hits += test_side(triangles, c.triangle, lines, c.side, p, parity[c.side], batch, block_accum);
+            }
+
+            #pragma omp atomic
+            hit_count += block_hits;
+
+            batch.flush(block_accum);
+            return block_accum;
+        });
+
+        hits += hit_count;
+        return accum;
+    }
+
+    // evaluates the sides of both triangles of every pair against the other triangle
+    template <typename test_t, typename eval_t>
+    eval::compensated_sum<eval_t> fused_narrowphase(const staged_mesh<test_t, eval_t> &first_mesh, const staged_mesh<test_t, eval_t> &second_mesh,
+                             const std::vector<pair_buffer> &buffers, std::vector<unsigned char> &first_parity,
+                             std::vector<unsigned char> &second_parity, std::size_t &hits) {
+        // chunks are filled in triangle order of the first mesh, so they are consumed as they are,
+        // pairs are addressed by their position in this order since the chunk sizes depend on the thread count
+        std::vector<const std::vector<triangle_pair> *> chunks;
+        std::vector<std::size_t> chunk_offsets(1, 0);
+        for (const auto &buffer : buffers) {
+            for (const auto &chunk : buffer.chunks) {
+                chunks.push_back(&chunk);
+                chunk_offsets.push_back(chunk_offsets.back() + chunk.size());
+            }
+        }
+
+        std::size_t hit_count = 0;
+
+        eval::compensated_sum<eval_t> accum = deterministic_reduce<eval_t>(chunk_offsets.back(), [&](std::size_t first, std::size_t last) {
+            eval::basic_term_batch<eval_t> batch;
+            eval::compensated_sum<eval_t> block_accum;
+            std::size_t block_hits = 0;
+
+            std::size_t chunk = std::upper_bound(chunk_offsets.begin(), chunk_offsets.end(), first) - chunk_offsets.begin() - 1;
+            for (std::size_t i = first; i < last; ++i) {
+                while (i >= chunk_offsets[chunk + 1])
+                    ++chunk;
+
+                const triangle_pair &pair = (*chunks[chunk])[i - chunk_offsets[chunk]];
+                for (std::size_t k = 0; k < 3; ++k) {
+                    std::size_t first_side = 3 * pair.first + k, second_side = 3 * pair.second + k;
+                    block_hits += test_side(second_mesh, pair.second, first_mesh, first_side, eval::lines_of_first_mesh,
+                                            first_parity[first_side], batch, block_accum);
+                    block_hits += test_side(first_mesh, pair.first, second_mesh, second_side, eval::lines_of_second_mesh,
+                                            second_parity[second_side], batch, block_accum);
+                }
+            }
+
+            #pragma omp atomic
+            hit_count += block_hits;
+
+            batch.flush(block_accum);
+            return block_accum;
+        });
+
+        hits += hit_count;
+        return accum;
+    }
+
+    // generate terms for side endpoints inside the other mesh, the end point is derived from the side's parity
+    template <typename float_t>
+    eval::compensated_sum<float_t> evaluate_endpoints(const std::vector<basic_ntriangle<float_t>> &lines, const std::vector<std::size_t> &unified_indices,
+                               const std::vector<char> &inside, const std::vector<unsigned char> &parity) {
+        return deterministic_reduce<float_t>(lines.size() * 3, [&](std::size_t first, std::size_t last) {
+            eval::compensated_sum<float_t> accum;
+            for (std::size_t i = first; i < last; ++i) {
+                bool start_inside = inside[unified_indices[i]] != 0;
+                bool end_inside = start_inside ^ (parity[i] != 0);
+                accum.add(eval::evaluate_line_intersection(extract_side(lines[i / 3], i % 3), start_inside, end_inside));
+            }
+            return accum;
+        });
+    }
+
+    // classification and broadphase run on the meshes in myfloat, the narrowphase on their staged copies
+    // the lines are classified against the whole other mesh, of which triangles may be a part
+    template <typename test_t, typename eval_t>
+    eval::compensated_sum<eval_t> pipelined_asymetric_intersect(const std::vector<ntriangle> &triangles, const std::vector<ntriangle> &lines,
+                                         const std::vector<ntriangle> &whole_triangles,
+                                         const staged_mesh<test_t, eval_t> &staged_triangles, const staged_mesh<test_t, eval_t> &staged_lines,
+                                         eval::perturbation p, pipeline_stats &stats) {
+        pipeline_clock::time_point start = pipeline_clock::now();
+
+        projected_classifier classifier(whole_triangles, p);
+        std::vector<myvec> unified_vertices;
+        std::vector<std::size_t> unified_indices;
+        std::vector<char> inside;
+        classify_vertices(classifier, lines, unified_vertices, unified_indices, inside);
+
+        stats.classification_seconds += seconds_since(start);
+        start = pipeline_clock::now();
+
+        triangle_grid grid(triangles);
+        std::vector<candidate_buffer> buffers;
+        broadphase(grid, lines, buffers);
+
+        stats.broadphase_seconds += seconds_since(start);
+        start = pipeline_clock::now();
+
+        std::vector<candidate> candidates;
+        sort_by_triangle(buffers, triangles.size(), candidates);
+
+        std::vector<unsigned char> parity(lines.size() * 3, 0);
+        eval::compensated_sum<eval_t> accum = narrowphase(staged_triangles, staged_lines, p, candidates, parity, stats.hits);
+        accum.add(evaluate_endpoints(staged_lines.triangles, unified_indices, inside, parity));
+
+        stats.narrowphase_seconds += seconds_since(start);
+        stats.sides += lines.size() * 3;
+        stats.candidates += candidates.size();
+
+        return accum;
+    }
+
+    template <typename test_t, typename eval_t>
+    eval::compensated_sum<eval_t> fused_intersect(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                           const std::vector<ntriangle> &whole_first, const std::vector<ntriangle> &whole_second,
+                           const staged_mesh<test_t, eval_t> &staged_first, const staged_mesh<test_t, eval_t> &staged_second,
+                           pipeline_stats &stats) {
+        pipeline_clock::time_point start = pipeline_clock::now();
+
+        std::vector<myvec> first_vertices, second_vertices;
+        std::vector<std::size_t> first_indices, second_indices;
+        std::vector<char> first_inside, second_inside;
+        classify_vertices(projected_classifier(whole_second, eval::lines_of_first_mesh), first_mesh, first_vertices, first_indices, first_inside);
+        classify_vertices(projected_classifier(whole_first, eval::lines_of_second_mesh), second_mesh, second_vertices, second_indices, second_inside);
+
+        stats.classification_seconds += seconds_since(start);
+        start = pipeline_clock::now();
+
+        triangle_grid grid(second_mesh);
+        std::vector<pair_buffer> buffers;
+        pair_broadphase(grid, first_mesh, buffers);
+
+        stats.broadphase_seconds += seconds_since(start);
+        start = pipeline_clock::now();
+
+        std::vector<unsigned char> first_parity(first_mesh.size() * 3, 0);
+        std::vector<unsigned char> second_parity(second_mesh.size() * 3, 0);
+        eval::compensated_sum<eval_t> accum = fused_narrowphase(staged_first, staged_second, buffers, first_parity, second_parity, stats.hits);
+        accum.add(evaluate_endpoints(staged_first.triangles, first_indices, first_inside, first_parity));
+        accum.add(evaluate_endpoints(staged_second.triangles, second_indices, second_inside, second_parity));
+
+        stats.narrowphase_seconds += seconds_since(start);
+        stats.sides += (first_mesh.size() + second_mesh.size()) * 3;
+        for (const auto &buffer : buffers)
+            for (const auto &chunk : buffer.chunks)
+                stats.candidates += chunk.size() * 6;
+
+        return accum;
+    }
+
+    // classification and broadphase have to see the coordinates of the narrowphase, otherwise they disagree on degenerate pairs
+    inline const std::vector<ntriangle> &local_mesh(const std::vector<ntriangle> &staged, std::vector<ntriangle> &) {
+        return staged;
+    }
+
+    template <typename float_t>
+    const std::vector<ntriangle> &local_mesh(const std::vector<basic_ntriangle<float_t>> &staged, std::vector<ntriangle> &storage) {
+        storage = convert_precision<myfloat>(staged);
+        return storage;
+    }
+
+    template <typename test_t, typename eval_t>
+    myfloat pipelined_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                             pipeline_stats &stats, pipeline_traversal traversal) {
+        myvec origin = local_origin(first_mesh, second_mesh);
+        staged_mesh<test_t, eval_t> whole_staged_first(first_mesh, origin), whole_staged_second(second_mesh, origin);
+
+        std::vector<ntriangle> first_storage, second_storage;
+        const std::vector<ntriangle> &whole_first = local_mesh(whole_staged_first.triangles, first_storage);
+        const std::vector<ntriangle> &whole_second = local_mesh(whole_staged_second.triangles, second_storage);
+
+        // only triangles in the overlap of both bounding boxes can cross the other mesh or have a vertex inside it
+        myvec first_min, first_max, second_min, second_max;
+        bounding_box(whole_first, first_min, first_max);
+        bounding_box(whole_second, second_min, second_max);
+        myvec min = glm::max(first_min, second_min), max = glm::min(first_max, second_max);
+        std::vector<std::size_t> first_indices = overlapping_triangles(whole_first, min, max);
+        std::vector<std::size_t> second_indices = overlapping_triangles(whole_second, min, max);
+
+        // the clipped copies are only made if they leave out any triangle
+        std::unique_ptr<staged_mesh<test_t, eval_t>> clipped_staged_first, clipped_staged_second;
+        std::vector<ntriangle> clipped_first, clipped_second;
+        if (first_indices.size() < whole_first.size()) {
+            clipped_staged_first.reset(new staged_mesh<test_t, eval_t>(whole_staged_first, first_indices));
+            clipped_first = subset(whole_first, first_indices);
+        }
+        if (second_indices.size() < whole_second.size()) {
+            clipped_staged_second.reset(new staged_mesh<test_t, eval_t>(whole_staged_second, second_indices));
+            clipped_second = subset(whole_second, second_indices);
+        }
+        const staged_mesh<test_t, eval_t> &staged_first = clipped_staged_first ? *clipped_staged_first : whole_staged_first;
+        const staged_mesh<test_t, eval_t> &staged_second = clipped_staged_second ? *clipped_staged_second : whole_staged_second;
+        const std::vector<ntriangle> &first = clipped_staged_first ? clipped_first : whole_first;
+        const std::vector<ntriangle> &second = clipped_staged_second ? clipped_second : whole_second;
+
+        eval::compensated_sum<eval_t> terms;
+        if (traversal == pipeline_traversal::fused) {
+            terms = fused_intersect(first, second, whole_first, whole_second, staged_first, staged_second, stats);
+        } else {
+            terms = pipelined_asymetric_intersect(first, second, whole_first, staged_first, staged_second, eval::lines_of_second_mesh, stats);
+            terms.add(pipelined_asymetric_intersect(second, first, whole_second, staged_second, staged_first, eval::lines_of_first_mesh, stats));
+        }
+
+        stats.error_estimate = (double) terms.error_estimate() / 6;
+        return (myfloat) (terms.value() / 6);
+    }
+
+    myfloat pipelined_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                          pipeline_stats *stats, pipeline_traversal traversal, precision p) {
+        pipeline_stats local_stats;
+        pipeline_stats &s = stats ? *stats : local_stats;
+
+        switch (p) {
+            case precision::single_precision:
+                return pipelined_volume<float, float>(first_mesh, second_mesh, s, traversal);
+            // the narrowphase has no integer kernels and falls back to double precision
+            case precision::fixed_point:
+            case precision::double_precision:
+                return pipelined_volume<double, double>(first_mesh, second_mesh, s, traversal);
+            default:
+                return pipelined_volume<float, double>(first_mesh, second_mesh, s, traversal);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef MI_PIPELINE_H
+#define MI_PIPELINE_H
+
+#include "globals.h"
+#include "intersect.h"
+
+#include <vector>
+
+namespace mesh {
+
+    struct pipeline_stats {
+        // sides tested, (side, triangle) pairs emitted by the broadphase and pairs intersecting on the segment
+        std::size_t sides = 0;
+        std::size_t candidates = 0;
+        std::size_t hits = 0;
+
+        double classification_seconds = 0;
+        double broadphase_seconds = 0;
+        double narrowphase_seconds = 0;
+
+        // first order estimate of the rounding error of the volume
+        double error_estimate = 0;
+
+        double rejection_rate() const { return candidates ? 1 - double(hits) / double(candidates) : 0; }
+    };
+
+    enum class pipeline_traversal {
+        // every side queries the other mesh, so overlapping triangle pairs are visited once per direction
+        per_side,
+        // every overlapping triangle pair is visited once and evaluated in both directions
+        fused
+    };
+
+    // two-phase engine, the broadphase emits candidate pairs which are then tested and evaluated by the narrowphase
+    myfloat pipelined_intersection_volume(const std::vector<ntriangle> &first_mesh, const std::vector<ntriangle> &second_mesh,
+                                          pipeline_stats *stats = nullptr, pipeline_traversal traversal = pipeline_traversal::fused,
+                                          precision p = default_precision);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef MI_REDUCTION_H
+#define MI_REDUCTION_H
+
+#include "evaluation.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace mesh {
+
+    // work items summed by a single thread, fixed so that the partial sums do not depend on the thread count
+    constexpr std::size_t reduction_block_size = 256;
+
+    // sums evaluate_block(first, last) over fixed blocks of [0, count), every block is evaluated by a single thread
+    // and the block sums are combined in a fixed pairwise order, so the result is bit-identical for any thread count
+    // partial holds the block sums, a reused buffer avoids the allocation
+    template <typename float_t, typename block_t>
+    eval::compensated_sum<float_t> deterministic_reduce(std::size_t count, block_t &&evaluate_block,
+                                                        std::vector<eval::compensated_sum<float_t>> &partial) {
+        const std::size_t blocks = (count + reduction_block_size - 1) / reduction_block_size;
+        partial.resize(blocks);
+
+        // proof-of-concept openmp support (requires signed variables)
+        #pragma omp parallel for schedule(dynamic)
+        for (std::int64_t i = 0; i < (std::int64_t) blocks; ++i) {
+            std::size_t first = std::size_t(i) * reduction_block_size;
+            std::size_t last = first + reduction_block_size < count ? first + reduction_block_size : count;
+            partial[i] = evaluate_block(first, last);
+        }
+
+        for (std::size_t width = 1; width < blocks; width *= 2)
+            for (std::size_t i = 0; i + width < blocks; i += 2 * width)
+                partial[i].add(partial[i + width]);
+
+        return blocks ? partial[0] : eval::compensated_sum<float_t>();
+    }
+
+    template <typename float_t, typename block_t>
+    eval::compensated_sum<float_t> deterministic_reduce(std::size_t count, block_t &&evaluate_block) {
+        std::vector<eval::compensated_sum<float_t>> partial;
+        return deterministic_reduce<float_t>(count, evaluate_block, partial);
+    }
+}
+
+#endif
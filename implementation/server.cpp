@@ -0,0 +1,334 @@
+
+#include "server.h"
+#include "mesh.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MI_UNIX_SOCKETS
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace mesh {
+
+    using server_clock = std::chrono::steady_clock;
+
+    double seconds_between(server_clock::time_point start, server_clock::time_point end) {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    std::size_t memory_footprint(const prepared_mesh &mesh) {
+        return sizeof(prepared_mesh) + mesh.triangles.capacity() * sizeof(ntriangle) + mesh.faces.planes.capacity() * sizeof(myvec4)
+               + mesh.faces.triangle_planes.capacity() * sizeof(std::size_t);
+    }
+
+    std::shared_ptr<const prepared_mesh> load_prepared_mesh(const std::string &path) {
+        std::vector<triangle> triangles;
+        if (!load_mesh(path, triangles))
+            throw std::runtime_error("Could not load " + path + ".");
+        return std::make_shared<const prepared_mesh>(prepare_mesh(triangles));
+    }
+
+    std::shared_ptr<const prepared_mesh> mesh_cache::get(const std::string &path, bool &hit) {
+        std::shared_ptr<const prepared_mesh> prepared = find(path);
+        hit = prepared != nullptr;
+        if (!hit) {
+            prepared = load_prepared_mesh(path);
+            insert(path, prepared);
+        }
+        return prepared;
+    }
+
+    std::shared_ptr<const prepared_mesh> mesh_cache::find(const std::string &path) {
+        auto found = index.find(path);
+        if (found == index.end()) {
+            ++misses;
+            return nullptr;
+        }
+        ++hits;
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->second;
+    }
+
+    void mesh_cache::insert(const std::string &path, std::shared_ptr<const prepared_mesh> prepared) {
+        // another loader was faster
+        if (index.count(path))
+            return;
+
+        // a mesh larger than the whole budget is handed out without displacing the others
+        std::size_t footprint = memory_footprint(*prepared) + path.size();
+        if (footprint > budget)
+            return;
+
+        entries.emplace_front(path, prepared);
+        index[path] = entries.begin();
+        bytes += footprint;
+
+        while (bytes > budget) {
+            const entry &last = entries.back();
+            bytes -= memory_footprint(*last.second) + last.first.size();
+            index.erase(last.first);
+            entries.pop_back();
+        }
+    }
+
+    std::string json_string(const std::string &value) {
+        std::ostringstream out;
+        out << '"';
+        for (char c : value) {
+            switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\r': out << "\\r"; break;
+                case '\t': out << "\\t"; break;
+                default:
+                    if ((unsigned char) c < 0x20)
+                        out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c << std::dec;
+                    else
+                        out << c;
+            }
+        }
+        out << '"';
+        return out.str();
+    }
+
+    // json has no representation for nan and infinity
+    std::string json_number(double value) {
+        if (!std::isfinite(value))
+            return "null";
+        std::ostringstream out;
+        out << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+        return out.str();
+    }
+
+    bool parse_transformation(std::istream &tokens, mymat4 &transformation) {
+        for (int i = 0; i < 16; ++i) {
+            double value;
+            if (!(tokens >> value))
+                return false;
+            transformation[i % 4][i / 4] = (myfloat) value;
+        }
+        return true;
+    }
+
+    std::string serve_request(const std::string &request, mesh_cache &cache) {
+        std::istringstream tokens(request);
+        std::vector<std::string> paths;
+        options opts;
+        std::string id, error, token;
+        mymat4 transformations[2] = {mymat4(1), mymat4(1)};
+        bool transformed[2] = {false, false};
+
+        while (error.empty() && tokens >> token) {
+            if (token == "--engine") {
+                if (!(tokens >> token) || !parse_engine(token, opts.engine))
+                    error = "Expected an engine after --engine.";
+            } else if (token == "--precision") {
+                if (!(tokens >> token) || !parse_precision(token, opts.precision))
+                    error = "Expected single, double, mixed or fixed after --precision.";
+            } else if (token == "--threads") {
+                if (!(tokens >> opts.threads) || opts.threads <= 0)
+                    error = "Expected a positive thread count after --threads.";
+            } else if (token == "--id") {
+                if (!(tokens >> id))
+                    error = "Expected a tag after --id.";
+            } else if (token == "--first-transform" || token == "--second-transform") {
+                int which = token == "--first-transform" ? 0 : 1;
+                transformed[which] = true;
+                if (!parse_transformation(tokens, transformations[which]))
+                    error = "Expected 16 values after " + token + ".";
+            } else {
+                paths.push_back(token);
+            }
+        }
+        if (error.empty() && paths.size() != 2)
+            error = "Expected two mesh paths.";
+
+        std::ostringstream response;
+        response << '{';
+        if (!id.empty())
+            response << "\"id\":" << json_string(id) << ',';
+
+        try {
+            if (!error.empty())
+                throw std::invalid_argument(error);
+
+            server_clock::time_point start = server_clock::now();
+            bool first_hit, second_hit;
+            std::shared_ptr<const prepared_mesh> cached[2] = {cache.get(paths[0], first_hit), cache.get(paths[1], second_hit)};
+            server_clock::time_point loaded = server_clock::now();
+
+            engine_report report;
+            myfloat volume;
+            server_clock::time_point prepared = loaded;
+            if (is_rigid(transformations[0]) && is_rigid(transformations[1])) {
+                // only the relative pose matters, the cached meshes are used as they are
+                mymat4 pose = inverse_rigid(transformations[0]) * transformations[1];
+                if (transformed[0] || transformed[1])
+                    volume = intersection_volume(*cached[0], *cached[1], pose, opts, &report);
+                else
+                    volume = intersection_volume(*cached[0], *cached[1], opts, &report);
+            } else {
+                // transformed copies only live for this request
+                prepared_mesh transformed_meshes[2];
+                const prepared_mesh *meshes[2] = {cached[0].get(), cached[1].get()};
+                for (int i = 0; i < 2; ++i) {
+                    if (transformed[i]) {
+                        transformed_meshes[i] = prepare_mesh(*cached[i], transformations[i]);
+                        meshes[i] = &transformed_meshes[i];
+                    }
+                }
+                prepared = server_clock::now();
+                volume = intersection_volume(*meshes[0], *meshes[1], opts, &report);
+            }
+
+            const char *engine = report.engine == engine_type::automatic ? "none" : find_engine(report.engine).name;
+            response << "\"volume\":" << json_number(volume)
+                     << ",\"error_estimate\":" << json_number(report.error_estimate)
+                     << ",\"engine\":" << json_string(engine)
+                     << ",\"precision\":" << json_string(precision_name(report.precision))
+                     << ",\"timings\":{\"load\":" << json_number(seconds_between(start, loaded))
+                     << ",\"transform\":" << json_number(seconds_between(loaded, prepared))
+                     << ",\"compute\":" << json_number(report.seconds);
+            if (report.engine == engine_type::pipelined) {
+                response << ",\"classification\":" << json_number(report.stats.classification_seconds)
+                         << ",\"broadphase\":" << json_number(report.stats.broadphase_seconds)
+                         << ",\"narrowphase\":" << json_number(report.stats.narrowphase_seconds);
+            }
+            response << "},\"cache\":{\"first_hit\":" << (first_hit ? "true" : "false")
+                     << ",\"second_hit\":" << (second_hit ? "true" : "false")
+                     << ",\"meshes\":" << cache.size()
+                     << ",\"bytes\":" << cache.size_bytes() << '}';
+        } catch (const std::exception &e) {
+            response << "\"error\":" << json_string(e.what());
+        }
+
+        response << '}';
+        return response.str();
+    }
+
+    bool is_blank(const std::string &line) {
+        return line.find_first_not_of(" \t\r") == std::string::npos;
+    }
+
+    void serve(std::istream &in, std::ostream &out, mesh_cache &cache) {
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!is_blank(line))
+                out << serve_request(line, cache) << std::endl;
+        }
+    }
+
+#ifdef MI_UNIX_SOCKETS
+    bool write_all(int connection, const std::string &data) {
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        for (std::size_t written = 0; written < data.size();) {
+            ssize_t n = send(connection, data.data() + written, data.size() - written, flags);
+            if (n <= 0)
+                return false;
+            written += (std::size_t) n;
+        }
+        return true;
+    }
+
+    void serve_connection(int connection, mesh_cache &cache) {
+        std::string buffer;
+        char chunk[4096];
+        for (;;) {
+            ssize_t n = read(connection, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            buffer.append(chunk, (std::size_t) n);
+
+            std::string::size_type newline;
+            while ((newline = buffer.find('\n')) != std::string::npos) {
+                std::string line = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+                if (!is_blank(line) && !write_all(connection, serve_request(line, cache) + '\n'))
+                    return;
+            }
+        }
+
+        // like std::getline, the last request does not need a newline if the client shuts down its side
+        if (!is_blank(buffer))
+            write_all(connection, serve_request(buffer, cache) + '\n');
+    }
+#endif
+
+    bool serve_socket(const std::string &path, mesh_cache &cache, std::string &error) {
+#ifdef MI_UNIX_SOCKETS
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            error = "The path is empty or too long for a socket.";
+            return false;
+        }
+        path.copy(address.sun_path, path.size());
+
+        // a stale socket of a previous run would make bind fail, anything else at the path belongs to the user
+        struct stat existing;
+        if (lstat(path.c_str(), &existing) == 0) {
+            if (!S_ISSOCK(existing.st_mode)) {
+                error = "The path exists and is not a socket.";
+                return false;
+            }
+            unlink(path.c_str());
+        }
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        if (bind(listener, (const sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+            error = std::strerror(errno);
+            close(listener);
+            return false;
+        }
+
+        for (;;) {
+            int connection = accept(listener, nullptr, nullptr);
+            if (connection < 0) {
+                // interrupted, or the client gave up while it was queued
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                // out of descriptors or buffers, which other processes may release, retrying at once would only spin
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    continue;
+                }
+                error = std::strerror(errno);
+                close(listener);
+                return false;
+            }
+            serve_connection(connection, cache);
+            close(connection);
+        }
+#else
+        (void) path;
+        (void) cache;
+        error = "Unix domain sockets are not supported on this platform.";
+        return false;
+#endif
+    }
+}
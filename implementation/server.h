@@ -0,0 +1,63 @@
+#ifndef MI_SERVER_H
+#define MI_SERVER_H
+
+#include "engine.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace mesh {
+
+    // prepared meshes keyed by path, the least recently used ones are dropped once the budget is exceeded
+    class mesh_cache {
+    public:
+        explicit mesh_cache(std::size_t budget_bytes) : budget(budget_bytes) {}
+
+        // loads and prepares the mesh on a miss, throws std::runtime_error if it cannot be loaded
+        std::shared_ptr<const prepared_mesh> get(const std::string &path, bool &hit);
+
+        // split lookup for callers which load outside of a lock, find returns nullptr on a miss
+        std::shared_ptr<const prepared_mesh> find(const std::string &path);
+        void insert(const std::string &path, std::shared_ptr<const prepared_mesh> prepared);
+
+        std::size_t size_bytes() const { return bytes; }
+        std::size_t size() const { return entries.size(); }
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+
+    private:
+        using entry = std::pair<std::string, std::shared_ptr<const prepared_mesh>>;
+
+        std::size_t budget;
+        std::size_t bytes = 0;
+        // most recently used first
+        std::list<entry> entries;
+        std::unordered_map<std::string, std::list<entry>::iterator> index;
+    };
+
+    std::size_t memory_footprint(const prepared_mesh &mesh);
+
+    // throws std::runtime_error if the mesh cannot be loaded
+    std::shared_ptr<const prepared_mesh> load_prepared_mesh(const std::string &path);
+
+    // a request is one line of whitespace separated tokens, like the launcher arguments:
+    //   <first path> <second path> [--engine e] [--precision p] [--threads n] [--id tag]
+    //   [--first-transform m00 m01 .. m33] [--second-transform m00 m01 .. m33]
+    // transforms are 16 row-major values, the answer is a single line of json
+    std::string serve_request(const std::string &request, mesh_cache &cache);
+
+    // answers every non-empty line until the end of the stream
+    void serve(std::istream &in, std::ostream &out, mesh_cache &cache);
+
+    // serves one connection after the other on a unix domain socket. a socket left at the path is replaced, any other
+    // file is not touched. returns false with the reason in error if the socket cannot be opened or accepting fails
+    // for another reason than a lack of resources
+    bool serve_socket(const std::string &path, mesh_cache &cache, std::string &error);
+}
+
+#endif
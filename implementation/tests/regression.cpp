@@ -0,0 +1,291 @@
+#include "engine.h"
+#include "evaluation.h"
+#include "globals.h"
+#include "incremental.h"
+#include "mesh.h"
+#include "multi.h"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include "glm/gtx/transform.hpp"
+#undef GLM_ENABLE_EXPERIMENTAL
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+
+// regression tests on the shipped meshes, ctest runs every test by its name
+
+mesh::prepared_mesh load(const std::string &name) {
+    return mesh::prepare_mesh(mesh::load_mesh(std::string(MI_MESH_DIRECTORY) + name + ".stl"));
+}
+
+// relative to the expected value, or absolute below one
+bool expect(const std::string &what, myfloat value, myfloat expected, myfloat tolerance) {
+    if (std::abs(value - expected) <= tolerance * std::max(myfloat(1), std::abs(expected)))
+        return true;
+    std::cerr << what << ": " << value << ", expected " << expected << std::endl;
+    return false;
+}
+
+// the spheres share their poles and the planes of their meridians, so every engine meets coplanar and collinear
+// configurations which only the exact predicates resolve consistently. the engines run directly, without the
+// pre-classification in front of them
+bool concentric_spheres() {
+    mesh::prepared_mesh inner = load("sphere10"), outer = load("sphere20");
+    const myfloat tolerance = 1000 * std::numeric_limits<myfloat>::epsilon();
+    bool passed = true;
+
+    for (const auto &info : mesh::registered_engines()) {
+        if (!info.available)
+            continue;
+
+        mesh::options opts;
+        opts.engine = info.type;
+        mesh::engine_report report;
+        passed &= expect(info.name, info.run(inner.triangles, outer.triangles, opts, report), inner.volume, tolerance);
+        passed &= expect(std::string(info.name) + " swapped", info.run(outer.triangles, inner.triangles, opts, report), inner.volume, tolerance);
+    }
+
+#ifdef MI_FIXED_POINT_SUPPORTED
+    mesh::options opts;
+    opts.engine = mesh::engine_type::brute_force;
+    opts.precision = mesh::precision::fixed_point;
+    // the vertices are snapped to the fixed point grid
+    passed &= expect("fixed", mesh::intersection_volume(inner, outer, opts), inner.volume, std::max(tolerance, myfloat(1e-6)));
+#endif
+    return passed;
+}
+
+myfloat pairwise(const mesh::prepared_mesh &first, const mesh::prepared_mesh &second) {
+    mesh::options opts;
+    opts.engine = mesh::engine_type::brute_force;
+    return mesh::intersection_volume(first, second, opts);
+}
+
+// the small sphere lies inside the large one and shares vertices with it, the cube cuts through both. the triple
+// intersection is the intersection of the small sphere and the cube, so inclusion-exclusion needs pairs only. the
+// tetrahedron lies far away from the spheres
+bool union_inclusion_exclusion() {
+    mesh::prepared_mesh small = load("sphere5"), medium = load("sphere10"), large = load("sphere30"), cube = load("unit-cube"),
+                        far = load("tetrahedron");
+    const myfloat tolerance = 1000 * std::numeric_limits<myfloat>::epsilon();
+    bool passed = expect("nested", pairwise(small, large), small.volume, tolerance);
+
+    myfloat expected = small.volume + large.volume + cube.volume - pairwise(small, large) - pairwise(small, cube)
+                       - pairwise(large, cube) + pairwise(small, cube);
+    passed &= expect("union", mesh::union_volume({&small, &large, &cube}), expected, tolerance);
+
+    expected = small.volume + medium.volume + large.volume + far.volume - pairwise(small, medium) - pairwise(small, large)
+               - pairwise(medium, large) + pairwise(small, medium);
+    passed &= expect("union with a distant mesh", mesh::union_volume({&small, &medium, &large, &far}), expected, tolerance);
+    return passed;
+}
+
+// the meshes are perturbed in their order, the volumes must not depend on it. the small sphere lies inside the large
+// one, so the intersection is that of the small sphere and the cube, the union that of the large sphere and the cube
+bool permuted_order() {
+    mesh::prepared_mesh small = load("sphere5"), large = load("sphere30"), cube = load("unit-cube");
+    const myfloat tolerance = 1000 * std::numeric_limits<myfloat>::epsilon();
+    const myfloat intersection = pairwise(small, cube);
+    const myfloat union_all = large.volume + cube.volume - pairwise(large, cube);
+
+    std::vector<const mesh::prepared_mesh *> meshes{&small, &large, &cube};
+    std::sort(meshes.begin(), meshes.end());
+    bool passed = true;
+    do {
+        passed &= expect("intersection", mesh::intersection_volume(meshes), intersection, tolerance);
+        passed &= expect("union", mesh::union_volume(meshes), union_all, tolerance);
+    } while (std::next_permutation(meshes.begin(), meshes.end()));
+    return passed;
+}
+
+// unit cubes at generic offsets, so the surfaces of all three cross in proper triple points. the intersections of axis
+// aligned boxes are boxes, which gives every term of inclusion-exclusion exactly
+bool offset_cubes() {
+    const myvec offsets[] = {myvec(0), myvec(0.31, 0.17, 0.23), myvec(0.52, 0.41, 0.37)};
+    auto overlap = [&](std::initializer_list<int> cubes) {
+        myvec min(-std::numeric_limits<myfloat>::infinity()), max(std::numeric_limits<myfloat>::infinity());
+        for (int i : cubes) {
+            min = glm::max(min, offsets[i]);
+            max = glm::min(max, offsets[i] + myfloat(1));
+        }
+        return (max.x - min.x) * (max.y - min.y) * (max.z - min.z);
+    };
+    const myfloat intersection = overlap({0, 1, 2});
+    const myfloat union_all = 3 - overlap({0, 1}) - overlap({0, 2}) - overlap({1, 2}) + intersection;
+    const myfloat tolerance = 1000 * std::numeric_limits<myfloat>::epsilon();
+    bool passed = expect("analytic intersection", intersection, myfloat(0.178416), tolerance);
+    passed &= expect("analytic union", union_all, myfloat(2.042677), tolerance);
+
+    mesh::prepared_mesh cubes[3];
+    for (int i = 0; i < 3; ++i)
+        cubes[i] = mesh::prepare_mesh(mesh::make_axis_aligned_unit_cube(glm::translate(offsets[i])));
+    std::vector<const mesh::prepared_mesh *> meshes{&cubes[0], &cubes[1], &cubes[2]};
+    std::sort(meshes.begin(), meshes.end());
+    do {
+        passed &= expect("intersection", mesh::intersection_volume(meshes), intersection, tolerance);
+        passed &= expect("union", mesh::union_volume(meshes), union_all, tolerance);
+    } while (std::next_permutation(meshes.begin(), meshes.end()));
+    return passed;
+}
+
+// the top of a unit box, bent down along x by depth in the middle
+myvec sagging_vertex(int i, int j, int n, myfloat depth, bool top) {
+    myfloat x = myfloat(i) / n, u = 2 * x - 1;
+    return myvec(x, myfloat(j) / n, top ? 1 - depth * (1 - u * u) : 0);
+}
+
+// top and bottom are grids of n by n quads, the sides are strips of n quads along the rim
+std::vector<triangle> sagging_box(int n, myfloat depth) {
+    auto v = [&](int i, int j, bool top) { return sagging_vertex(i, j, n, depth, top); };
+    std::vector<triangle> mesh;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            mesh.emplace_back(v(i, j, true), v(i + 1, j, true), v(i + 1, j + 1, true));
+            mesh.emplace_back(v(i, j, true), v(i + 1, j + 1, true), v(i, j + 1, true));
+            mesh.emplace_back(v(i, j, false), v(i + 1, j + 1, false), v(i + 1, j, false));
+            mesh.emplace_back(v(i, j, false), v(i, j + 1, false), v(i + 1, j + 1, false));
+        }
+    }
+    for (int k = 0; k < n; ++k) {
+        mesh.emplace_back(v(k, 0, false), v(k + 1, 0, false), v(k + 1, 0, true));
+        mesh.emplace_back(v(k, 0, false), v(k + 1, 0, true), v(k, 0, true));
+        mesh.emplace_back(v(k, n, false), v(k + 1, n, true), v(k + 1, n, false));
+        mesh.emplace_back(v(k, n, false), v(k, n, true), v(k + 1, n, true));
+        mesh.emplace_back(v(0, k, false), v(0, k + 1, true), v(0, k + 1, false));
+        mesh.emplace_back(v(0, k, false), v(0, k, true), v(0, k + 1, true));
+        mesh.emplace_back(v(n, k, false), v(n, k + 1, false), v(n, k + 1, true));
+        mesh.emplace_back(v(n, k, false), v(n, k + 1, true), v(n, k, true));
+    }
+    return mesh;
+}
+
+// every edge of the dented top bends inwards by less than the tolerance of the convexity test, only the dent as a
+// whole shows that the box is not convex. the probe stands on the rim, which the planes of the dent would cut off
+bool sagging_box() {
+    const int n = 100, columns = 3;
+    const myfloat depth = myfloat(5e-4);
+    mesh::prepared_mesh box = mesh::prepare_mesh(sagging_box(n, depth));
+    mesh::prepared_mesh probe = mesh::prepare_mesh(mesh::make_axis_aligned_unit_cube(
+            glm::translate(myvec(myfloat(n - columns) / n, 0.47, 0.9999)) * glm::scale(myvec(0.06, 0.06, 0.2))));
+
+    bool passed = box.faces.empty();
+    if (!passed)
+        std::cerr << "convex: " << box.faces.planes.size() << " planes" << std::endl;
+
+    // the top is linear along each column of the grid under the probe
+    myfloat expected = 0;
+    for (int i = n - columns; i < n; ++i)
+        expected += ((sagging_vertex(i, 0, n, depth, true).z + sagging_vertex(i + 1, 0, n, depth, true).z) / 2 - probe.min.z) / n;
+    expected *= probe.max.y - probe.min.y;
+
+    const myfloat tolerance = 1000 * std::numeric_limits<myfloat>::epsilon();
+    for (mesh::engine_type engine : {mesh::engine_type::automatic, mesh::engine_type::brute_force}) {
+        mesh::options opts;
+        opts.engine = engine;
+        const char *name = engine == mesh::engine_type::automatic ? "automatic" : "brute";
+        passed &= expect(name, mesh::intersection_volume(box, probe, opts) / expected, 1, tolerance);
+    }
+    return passed;
+}
+
+// central differences of the volume along each translation and about each axis through a corner of the cube, the step
+// balances the truncation error against the rounding of the volume
+bool pose_gradient() {
+    mesh::prepared_mesh sphere = load("sphere10"), cube = load("unit-cube");
+    const mymat4 pose = glm::translate(myvec(0.31, 0.17, 0.23)) * glm::rotate(myfloat(0.3), glm::normalize(myvec(1, 2, 3)));
+    const myvec centre = myvec(pose * myvec4(cube.min, 1));
+    const myfloat step = std::cbrt(std::numeric_limits<myfloat>::epsilon());
+    const myfloat tolerance = 10 * step * step;
+
+    mesh::volume_gradient gradient;
+    myfloat volume = mesh::intersection_volume_gradient(sphere, cube, pose, centre, gradient);
+    mesh::options opts;
+    opts.engine = mesh::engine_type::brute_force;
+    bool passed = expect("volume", volume, mesh::intersection_volume(sphere, cube, pose, opts), tolerance);
+
+    auto moved = [&](const mymat4 &motion) { return mesh::intersection_volume(sphere, cube, motion * pose, opts); };
+    for (int axis = 0; axis < 3; ++axis) {
+        myvec direction(0);
+        direction[axis] = 1;
+        myfloat translation = (moved(glm::translate(step * direction)) - moved(glm::translate(-step * direction))) / (2 * step);
+        passed &= expect("translation " + std::to_string(axis), gradient.translation[axis], translation, tolerance);
+
+        auto rotated = [&](myfloat angle) { return glm::translate(centre) * glm::rotate(angle, direction) * glm::translate(-centre); };
+        myfloat rotation = (moved(rotated(step)) - moved(rotated(-step))) / (2 * step);
+        passed &= expect("rotation " + std::to_string(axis), gradient.rotation[axis], rotation, tolerance);
+    }
+    return passed;
+}
+
+// the cube moves across the surface of the sphere in small rigid steps. every step is compared with a fresh evaluation
+// of the pose, and has to retest some, but not all, of the sides
+bool incremental_steps() {
+    mesh::prepared_mesh sphere = load("sphere20"), cube = load("unit-cube");
+    const mymat4 start = glm::translate(myvec(0.31, 0.17, 0.23)) * glm::rotate(myfloat(0.3), glm::normalize(myvec(1, 2, 3)));
+    const myvec velocity(0.008, -0.006, 0.004), spin = glm::normalize(myvec(-2, 1, 3));
+    const std::size_t sides = 3 * (sphere.triangles.size() + cube.triangles.size());
+    const myfloat tolerance = 1000 * std::numeric_limits<myfloat>::epsilon();
+    mesh::options opts;
+    opts.engine = mesh::engine_type::brute_force;
+
+    mesh::incremental_query query(sphere, cube, start);
+    bool passed = expect("initial", query.volume(), mesh::intersection_volume(sphere, cube, start, opts), tolerance);
+    if (query.retested_sides() != sides) {
+        std::cerr << "initial: " << query.retested_sides() << " sides tested, expected " << sides << std::endl;
+        passed = false;
+    }
+
+    for (int step = 1; step <= 100; ++step) {
+        const mymat4 pose = glm::translate(myfloat(step) * velocity) * start * glm::rotate(myfloat(0.006) * step, spin);
+        const myvec centre = myvec(pose * myvec4(cube.min, 1));
+        const std::string what = "step " + std::to_string(step);
+
+        passed &= expect(what, query.move(pose), mesh::intersection_volume(sphere, cube, pose, opts), tolerance);
+
+        mesh::volume_gradient expected, gradient = query.gradient(centre);
+        mesh::intersection_volume_gradient(sphere, cube, pose, centre, expected);
+        for (int axis = 0; axis < 3; ++axis) {
+            passed &= expect(what + " translation", gradient.translation[axis], expected.translation[axis], tolerance);
+            passed &= expect(what + " rotation", gradient.rotation[axis], expected.rotation[axis], tolerance);
+        }
+
+        if (query.retested_sides() == 0 || query.retested_sides() >= sides) {
+            std::cerr << what << ": " << query.retested_sides() << " of " << sides << " sides retested" << std::endl;
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+struct regression_test {
+    const char *name;
+    bool (*run)();
+};
+
+const regression_test tests[] = {
+        {"concentric_spheres", concentric_spheres},
+        {"union_inclusion_exclusion", union_inclusion_exclusion},
+        {"permuted_order", permuted_order},
+        {"offset_cubes", offset_cubes},
+        {"sagging_box", sagging_box},
+        {"pose_gradient", pose_gradient},
+        {"incremental_steps", incremental_steps}
+};
+
+int main(int argc, char **argv) {
+    std::cerr << std::setprecision(std::numeric_limits<myfloat>::digits10 + 1);
+
+    for (const auto &test : tests)
+        if (argc == 2 && std::strcmp(argv[1], test.name) == 0)
+            return test.run() ? 0 : 1;
+
+    std::cerr << "Expected the name of a test." << std::endl;
+    return 2;
+}
@@ -0,0 +1,26 @@
+#ifndef MI_WORKSPACE_H
+#define MI_WORKSPACE_H
+
+#include "evaluation.h"
+#include "globals.h"
+#include "localized.h"
+
+#include <vector>
+
+namespace mesh {
+
+    // caller-owned buffers for repeated queries, once they have grown to the mesh sizes a query does not allocate.
+    // a workspace must not be shared by concurrent queries
+    struct workspace {
+        // normals of triangle input
+        std::vector<ntriangle> first_mesh;
+        std::vector<ntriangle> second_mesh;
+        // both meshes relative to the local origin
+        std::vector<ntriangle> first_local;
+        std::vector<ntriangle> second_local;
+        std::vector<eval::compensated_sum<myfloat>> partial_sums;
+        localized_workspace localized;
+    };
+}
+
+#endif